@@ -14,7 +14,7 @@ int main (int argc, char** argv)
 
   if (argc < 2)
   {
-    fprintf(stderr, "Usage: %s <rom_name>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <rom_name> [options] (--help lists them)\n", argv[0]);
     exit(EXIT_FAILURE);
   }
 
@@ -23,51 +23,249 @@ int main (int argc, char** argv)
   if (!init_user_configuration(&config_parameters, argc, argv))
     exit(EXIT_FAILURE);
 
-  // Exit if SDL not initialized
+  // Exit if the ROM cannot be mapped
+  rom_file_t rom_file = {0};
+  if (!map_rom_file(&rom_file, rom_name))
+    exit(EXIT_FAILURE);
+
+  // Settings stored for this ROM in the library fill in whatever was not given on the command line
+  apply_rom_profile(&config_parameters, &rom_file);
+
+  // Calibrate for this host, the result is saved as this ROM's profile
+  if (config_parameters.autotune && !run_autotune(&config_parameters, &rom_file))
+    exit(EXIT_FAILURE);
+
+  if (config_parameters.library_save && !save_rom_profile(&config_parameters, &rom_file))
+    exit(EXIT_FAILURE);
+
+  // Batch mode runs many headless copies of the ROM and exits without opening a window
+  if (config_parameters.batch_lanes > 0)
+    exit(run_chip8_batch(&config_parameters, &rom_file, config_parameters.seed ? config_parameters.seed : (uint32_t)time(NULL)) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+  // Exit if SDL not initialized (headless runs never open a window)
   sdl_params_t sdl_parameters = {0};
-  if (!init_sdl(&sdl_parameters, config_parameters))
+  if (!config_parameters.headless && !init_sdl(&sdl_parameters, config_parameters))
     exit(EXIT_FAILURE);
 
   // Exit if Chip8 not initialized
   chip8_t chip8_instnace = {0};
-  if (!init_chip8(&chip8_instnace, rom_name))
+  if (!init_chip8(&chip8_instnace, &rom_file))
     exit(EXIT_FAILURE);
 
-  clear_window(&sdl_parameters, &config_parameters);
+  // Exit if an input script was given but could not be read
+  uint32_t num_input_events = 0;
+  uint32_t next_input_event = 0;
+  input_event_t* input_events = NULL;
+  if (config_parameters.input_script_path != NULL &&
+      (input_events = load_input_script(config_parameters.input_script_path, 1, &num_input_events)) == NULL)
+    exit(EXIT_FAILURE);
+
+  // Exit if the shared memory interface was asked for but not initialized
+  shm_params_t shm_parameters = {0};
+  if (config_parameters.shm_name != NULL && !init_shared_memory(&shm_parameters, &config_parameters))
+    exit(EXIT_FAILURE);
+
+  // Exit if frame capture was asked for but not initialized
+  capture_params_t capture_parameters = {0};
+  if (config_parameters.capture_path != NULL && !init_capture(&capture_parameters, &config_parameters))
+    exit(EXIT_FAILURE);
+
+  // Exit if tracing was asked for but not initialized
+  trace_params_t trace_parameters = {0};
+  if (config_parameters.trace_path != NULL && !init_tracer(&trace_parameters, &config_parameters))
+    exit(EXIT_FAILURE);
 
-  // Seed Random Number Generation
-  srand(time(NULL));
+  // Exit if the debugger console port was asked for but could not be opened
+  debugger_params_t debugger_parameters;
+  if (!init_debugger(&debugger_parameters, &config_parameters))
+    exit(EXIT_FAILURE);
+  debugger_parameters.tracer = &trace_parameters;
+
+  if (!config_parameters.headless)
+    clear_window(&sdl_parameters, &config_parameters);
+
+  // Seed Random Number Generation (fixed seed makes runs reproducible)
+  chip8_instnace.emu_rng_state = chip8_random_seed(config_parameters.seed ? config_parameters.seed : (uint32_t)time(NULL));
+
+  uint32_t frames_emulated = 0;
+  input_latency_t input_latency = {0};
+  vip_timing_t vip_timing = {0};
+
+  // Frames are paced to 60Hz deadlines unless uncapped or driven by a lockstep consumer
+  // Each frame's instructions (or VIP machine cycles) run in input_polls slices spread over the frame, with input polled before each one
+  const bool paced_frames = !config_parameters.shm_lockstep && !config_parameters.uncapped;
+  const uint64_t frame_period = SDL_GetPerformanceFrequency() / 60;
+  const uint32_t instructions_per_frame = (config_parameters.instructions_per_second)/60;
+  const uint32_t input_polls = config_parameters.input_polls_per_frame;
+  uint64_t frame_deadline = 0;
 
   while (chip8_instnace.emu_state != QUIT)
   {
+    // Sleep before reading input (not between emulating and presenting) so a key press reaches the screen sooner
+    if (paced_frames)
+      wait_for_frame_deadline(&frame_deadline);
+
+    const uint64_t frame_start = frame_deadline - frame_period;
+
     // Handles all user input until nothing remains in the input queue
-    handle_user_input(&chip8_instnace);
+    if (!config_parameters.headless)
+      handle_user_input(&chip8_instnace, &config_parameters, &debugger_parameters, &input_latency);
+
+    if (debugger_parameters.console)
+      debug_poll_console(&debugger_parameters, &chip8_instnace);
+
+    // An external quit is honoured whatever state the emulator is in
+    if (shm_parameters.shm != NULL && shared_memory_quit_requested(&shm_parameters))
+      chip8_instnace.emu_state = QUIT;
+
+    if (chip8_instnace.emu_state == QUIT) {break;}
 
     if (chip8_instnace.emu_state == PAUSE) {continue;}
 
-    uint64_t time_before_instructions = SDL_GetPerformanceCounter();
+    // Stopped in the debugger: keep the window alive until a continue/step command
+    if (chip8_instnace.emu_state == DEBUG_BREAK)
+    {
+      if (!config_parameters.headless)
+        update_window(&sdl_parameters, &config_parameters, &chip8_instnace);
+
+      if (!paced_frames)
+        SDL_Delay(16);
+      continue;
+    }
 
-    // Emulate some instructions for this frame
-    for (uint32_t i=0; i<(config_parameters.instructions_per_second)/60; i++)
+    // External processes can inject keys, and in lockstep mode decide when the next frame runs
+    if (shm_parameters.shm != NULL)
     {
-      emulate_instructions(&chip8_instnace, &config_parameters);
+      if (config_parameters.shm_lockstep && !shared_memory_await_frame(&shm_parameters)) {continue;}
+
+      shared_memory_apply_input(&shm_parameters, &chip8_instnace);
+      if (chip8_instnace.emu_state == QUIT) {break;}
     }
 
-    uint64_t time_after_instructions = SDL_GetPerformanceCounter();
-    double time_emulating_instruction = (double)((time_after_instructions - time_before_instructions) / 1000) / SDL_GetPerformanceFrequency();
+    // Scripted key presses hold from the start of their frame until the next line changes them
+    for (; next_input_event < num_input_events && input_events[next_input_event].frame <= frames_emulated; next_input_event++)
+    {
+      for (uint8_t key=0; key<16; key++)
+        chip8_instnace.emu_keypad[key] = (input_events[next_input_event].keys >> key) & 0x01;
+    }
 
-    // Delay by ((1/60) * 1000) to get delay in ms for 60HZ 
-    SDL_Delay(16.66f > time_emulating_instruction ? 16.66f - time_emulating_instruction : 0);
+    if (config_parameters.vip_timing)
+      vip_begin_frame(&vip_timing);
+
+    for (uint32_t slice=0; slice<input_polls; slice++)
+    {
+      // Later slices wait for their share of the frame, then pick up any key pressed meanwhile
+      if (slice > 0)
+      {
+        if (paced_frames)
+          wait_until(frame_start + frame_period * slice / input_polls);
+
+        if (!config_parameters.headless)
+          handle_user_input(&chip8_instnace, &config_parameters, &debugger_parameters, &input_latency);
+      }
+
+      if (chip8_instnace.emu_state != RUNNING) {break;}
+
+      // VIP timing: run to this slice's share of the cycle budget instead of an instruction count
+      if (config_parameters.vip_timing)
+      {
+        emulate_vip_cycles(&vip_timing, &chip8_instnace, &config_parameters, &debugger_parameters, &trace_parameters,
+                           VIP_FRAME_CYCLE_BUDGET * (slice + 1) / input_polls);
+        continue;
+      }
+
+      const uint32_t slice_instructions = instructions_per_frame * (slice + 1) / input_polls - instructions_per_frame * slice / input_polls;
+
+      // Emulate this slice of the frame (checked or traced paths only while the debugger/tracer is in use)
+      if (debugger_parameters.armed)
+      {
+        debug_emulate_instructions(&debugger_parameters, &chip8_instnace, &config_parameters, slice_instructions);
+      }
+      else if (trace_parameters.active)
+      {
+        for (uint32_t i=0; i<slice_instructions; i++)
+        {
+          trace_emulate_instruction(&trace_parameters, &chip8_instnace, &config_parameters);
+        }
+      }
+      else
+      {
+        for (uint32_t i=0; i<slice_instructions; i++)
+        {
+          emulate_instructions(&chip8_instnace, &config_parameters);
+        }
+      }
+    }
+
+    if (config_parameters.vip_timing)
+      vip_end_frame(&vip_timing);
+
+    if (chip8_instnace.emu_state == QUIT) {break;}
+
+    // Present as soon as the frame is emulated
+    if (!config_parameters.headless)
+    {
+      update_window(&sdl_parameters, &config_parameters, &chip8_instnace);
+      record_input_latency(&input_latency);
+    }
 
-    update_window(&sdl_parameters, &config_parameters, &chip8_instnace);
     update_timers(&chip8_instnace);
+
+    if (capture_parameters.frame_buffer != NULL)
+      capture_frame(&capture_parameters, &chip8_instnace);
+
+    if (shm_parameters.shm != NULL)
+      shared_memory_publish_frame(&shm_parameters, &chip8_instnace);
+
+    // Stop after a fixed number of frames if asked to
+    frames_emulated++;
+    if (config_parameters.max_frames != 0 && frames_emulated >= config_parameters.max_frames)
+      chip8_instnace.emu_state = QUIT;
   }
 
   if (chip8_instnace.emu_state == QUIT)
     SDL_Log("\nchip8Emu quiting ... bye :((\n");
 
-  SDL_DestroyRenderer(sdl_parameters.main_renderer);
-  SDL_DestroyWindow(sdl_parameters.main_window);
+  // Compare the final machine state against the expected hash (conformance runs)
+  int exit_code = EXIT_SUCCESS;
+  if (config_parameters.print_hash || config_parameters.check_hash)
+  {
+    const uint64_t state_hash = hash_chip8_state(&chip8_instnace);
+
+    if (config_parameters.print_hash)
+      printf("%s state hash after %u frames: %016llx\n", rom_name, (unsigned int)frames_emulated, (unsigned long long)state_hash);
+
+    if (config_parameters.check_hash && state_hash != config_parameters.expected_hash)
+    {
+      SDL_Log("%s state hash %016llx does not match expected %016llx", rom_name, (unsigned long long)state_hash, (unsigned long long)config_parameters.expected_hash);
+      exit_code = EXIT_FAILURE;
+
+      if (config_parameters.hash_fail_png != NULL && !write_display_png(config_parameters.hash_fail_png, &config_parameters, &chip8_instnace))
+        SDL_Log("Could not write %s", config_parameters.hash_fail_png);
+
+      if (config_parameters.hash_diff_png != NULL &&
+          !write_display_diff_png(config_parameters.hash_diff_reference, config_parameters.hash_diff_png, &config_parameters, &chip8_instnace))
+        SDL_Log("Could not write %s", config_parameters.hash_diff_png);
+    }
+  }
+
+  if (config_parameters.latency_stats)
+    report_input_latency(&input_latency);
+
+  if (config_parameters.vip_timing)
+    report_vip_timing(&vip_timing);
+
+  free(input_events);
+  close_debugger(&debugger_parameters);
+  close_tracer(&trace_parameters);
+  unmap_rom_file(&rom_file);
+  close_capture(&capture_parameters);
+  close_shared_memory(&shm_parameters);
+
+  if (!config_parameters.headless)
+  {
+    close_sdl(&sdl_parameters);
+  }
   SDL_Quit();
-  return 0; 
+  return exit_code;
 }
\ No newline at end of file
@@ -4,16 +4,94 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+// CPU side scaler used by the filtered render modes
+typedef struct
+{
+  uint32_t display_width;
+  uint32_t display_height;
+  uint32_t out_width;
+  uint32_t out_height;
+
+  // Brightness of every display pixel (0 = background, 255 = foreground), kept between frames for the phosphor fade
+  // intensity points inside intensity_buffer, which has a one pixel border for the Scale2x neighbours
+  uint8_t* intensity_buffer;
+  uint8_t* intensity;
+  uint32_t intensity_stride;
+
+  // Scale2x output (twice the display size)
+  uint8_t* scaled;
+
+  // Output column -> source column, and brightness -> 0xRRGGBBAA color between bg and fg
+  int32_t* x_index;
+  uint32_t palette[256];
+} render_params_t;
+
 
 // Main SDL Parameters used in a lot of functions
 typedef struct
 {
   SDL_Window* main_window;
   SDL_Renderer* main_renderer;
+
+  // Title font, opened once by init_sdl (NULL if it could not be loaded, the title is then left out)
+  TTF_Font* title_font;
+
+  // Filtered render modes only: streaming texture the scaled frame is written into
+  SDL_Texture* frame_texture;
+  render_params_t* render;
 } sdl_params_t;
 
 
+// Output formats for headless frame capture
+typedef enum
+{
+  CAPTURE_Y4M = 0,
+  CAPTURE_RGBA = 1,
+  CAPTURE_PNG = 2
+} capture_format_t;
+
+
+// How update_window draws the display: one rectangle per pixel, or through the CPU scaler into a single texture
+typedef enum
+{
+  RENDER_RECTS = 0,
+  RENDER_NEAREST = 1,
+  RENDER_SCALE2X = 2
+} render_filter_t;
+
+
+// Platform a ROM was written for, each one implies a default quirk set
+typedef enum
+{
+  PLATFORM_DEFAULT = 0,     // This emulator's original behaviour (no quirks)
+  PLATFORM_COSMAC_VIP = 1,
+  PLATFORM_CHIP48 = 2,
+  PLATFORM_SCHIP = 3
+} rom_platform_t;
+
+// Interpreter quirks (bits of user_config_params_t.quirks)
+#define QUIRK_VF_RESET          0x01u   // 8XY1/8XY2/8XY3 clear VF
+#define QUIRK_SHIFT_USES_VY     0x02u   // 8XY6/8XYE shift VY into VX
+#define QUIRK_MEMORY_INCREMENT  0x04u   // FX55/FX65 leave I pointing past the last register
+#define QUIRK_JUMP_VX           0x08u   // BXNN jumps to XNN + VX instead of NNN + V0
+
+// Config fields that were given on the command line (cli_set, a ROM profile or autotune never overrides these)
+// or in the config file (config_set, only defaults: a ROM profile or autotune still replaces them)
+#define CFG_SET_PLATFORM  0x01u
+#define CFG_SET_QUIRKS    0x02u
+#define CFG_SET_IPS       0x04u
+#define CFG_SET_COLORS    0x08u
+#define CFG_SET_KEYMAP    0x10u
+#define CFG_SET_SCALE     0x20u
+#define CFG_SET_FILTER    0x40u
+
+
 // User may want to pass these in as customisable parameters
 typedef struct
 {
@@ -27,6 +105,87 @@ typedef struct
   bool pixel_outlines;
   uint32_t instructions_per_second;
 
+  // Shared memory interface for external processes (NULL name = disabled)
+  // Lockstep only runs a frame when a consumer requests one
+  const char* shm_name;
+  bool shm_lockstep;
+
+  // Headless batch mode: run this many copies of the ROM side by side (0 = disabled)
+  // Optional input script giving each lane its own key presses (NULL = no keys pressed)
+  uint32_t batch_lanes;
+  uint32_t batch_frames;
+  const char* batch_input_path;
+
+  // Run without a window, optionally as fast as possible and/or for a fixed number of frames (0 = until quit)
+  bool headless;
+  bool uncapped;
+  uint32_t max_frames;
+
+  // Keys pressed on a schedule, same format as the batch input with lane 0 or * (NULL = no script)
+  const char* input_script_path;
+
+  // Frame capture (NULL path = disabled), PNG paths are a printf pattern for the frame number
+  const char* capture_path;
+  capture_format_t capture_format;
+  bool capture_dedup;
+
+  // Fixed random seed for reproducible runs (0 = seed from the clock)
+  uint32_t seed;
+
+  // Print the machine state hash on exit, and/or fail (writing a PNG of the last frame, and a diff against a reference PNG) if it differs from the expected one
+  bool print_hash;
+  bool check_hash;
+  uint64_t expected_hash;
+  const char* hash_fail_png;
+  const char* hash_diff_reference;
+  const char* hash_diff_png;
+
+  // Debugger console on stdin or on a 127.0.0.1 TCP port (0 = none, takes over from stdin), and an optional breakpoint armed at startup (-1 = none)
+  bool debug_console;
+  uint32_t debug_port;
+  int32_t debug_break_pc;
+
+  // Execution trace file (NULL = disabled), flight recorder keeps only the last trace_records instructions in memory
+  const char* trace_path;
+  bool trace_flight_recorder;
+  uint32_t trace_records;
+
+  // Host key for each chip8 key 0-F, how many times input is polled per frame, and whether to report input latency on exit
+  SDL_Keycode keymap[16];
+  uint32_t input_polls_per_frame;
+  bool latency_stats;
+
+  // Target platform and its interpreter quirks (QUIRK_* bits)
+  rom_platform_t platform;
+  uint32_t quirks;
+
+  // ROM library index with per-ROM profiles, applied at load unless the setting was given on the command line (CFG_SET_* bits)
+  // library_save stores the current settings as this ROM's profile
+  const char* library_path;
+  bool library_save;
+  const char* library_title;
+  uint32_t cli_set;
+  uint32_t config_set;
+
+  // Display filter, and how much of last frame's glow an unlit pixel keeps (x/256 per frame, 0 = no phosphor)
+  render_filter_t render_filter;
+  uint8_t phosphor_decay;
+
+  // Charge instructions their COSMAC VIP cycle cost and run each frame to a cycle budget (instructions_per_second is then unused)
+  bool vip_timing;
+
+  // Settings file applied before the command line (NULL = none)
+  const char* config_path;
+
+  // Measure this host and ROM, then pick the highest IPS (up to autotune_max_ips), scale and filter that keep 60 fps
+  // with autotune_headroom percent of every frame to spare
+  bool autotune;
+  uint32_t autotune_headroom;
+  uint32_t autotune_max_ips;
+
+  // Open the window hidden (autotune calibration)
+  bool hidden_window;
+
 } user_config_params_t;
 
 
@@ -35,10 +194,15 @@ typedef enum
 {
   QUIT = 0,
   RUNNING = 1,
-  PAUSE = 2
+  PAUSE = 2,
+  DEBUG_BREAK = 3
 } current_state_t;
 
 
+// Display size in chip8 pixels (emu_display and the shared memory frame are this many bools, row major)
+#define CHIP8_DISPLAY_WIDTH   64
+#define CHIP8_DISPLAY_HEIGHT  32
+
 // Could have multiple chip8_t instances for multiple windows simulatanoeusly 
 typedef struct
 {
@@ -52,7 +216,7 @@ typedef struct
   
   // Using bool to store whether each pixel is on or off (instead of storing it in a part of RAM)
   // Originally, this was 256B and each pixel was represented by 1 bit (8b * 256B = 2048 pixels)
-  bool emu_display[64*32];
+  bool emu_display[CHIP8_DISPLAY_WIDTH*CHIP8_DISPLAY_HEIGHT];
 
   // Subroutine stack for 12 levels of subroutines (look into this more)
   uint16_t emu_subrStack[12];
@@ -72,10 +236,387 @@ typedef struct
 
   // Whether each of the 16 keys is pressed or not
   bool emu_keypad[16];
+
+  // Xorshift32 state for CXNN (the same generator as the batch lanes, so equal seeds draw equal numbers)
+  uint32_t emu_rng_state;
  
 } chip8_t;
 
 
+// Input-to-present latency: time from a keypad press to the first frame presented after it (1 ms histogram buckets)
+#define LATENCY_HISTOGRAM_BUCKETS 100
+
+typedef struct
+{
+  bool pending;
+  uint32_t pending_since;
+
+  uint32_t num_samples;
+  uint64_t total_ms;
+  uint32_t max_ms;
+  uint32_t histogram[LATENCY_HISTOGRAM_BUCKETS];
+} input_latency_t;
+
+
+// COSMAC VIP timing mode: frames are scheduled by 1802 machine cycles instead of a fixed instruction count
+// 3668 cycles per 60Hz frame, of which the 1861 video chip takes 1024 for display DMA (8 bytes x 128 lines)
+#define VIP_CYCLES_PER_FRAME      3668
+#define VIP_DISPLAY_DMA_CYCLES    1024
+#define VIP_FRAME_CYCLE_BUDGET    (VIP_CYCLES_PER_FRAME - VIP_DISPLAY_DMA_CYCLES)
+
+typedef struct
+{
+  // Current frame, a DXYN ends it early. It starts at the previous frame's carry: the cycles its last instruction overran
+  // the budget by (never negative, budget a display wait leaves unused is lost)
+  int32_t frame_cycles;
+  int32_t carry_cycles;
+  bool display_wait;
+  uint32_t frame_instructions;
+
+  // Instructions per frame over the run
+  uint64_t num_frames;
+  uint64_t total_instructions;
+  uint32_t min_frame_instructions;
+  uint32_t max_frame_instructions;
+  uint64_t display_wait_frames;
+} vip_timing_t;
+
+
+// Shared memory segment layout seen by external processes
+// Readers use the seqlock: read frame_seq (retry while odd), copy the frame data, then re-read frame_seq and retry if it changed
+// Writers from outside only touch frames_requested, keypad_inject and control
+#define CHIP8_SHM_MAGIC     0x43385348u   // "C8SH"
+#define CHIP8_SHM_VERSION   1u
+
+#define CHIP8_SHM_CTRL_QUIT 0x01u
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+
+  // Seqlock counter (odd while a frame is being published), also used as a futex to wait for new frames
+  _Atomic uint32_t frame_seq;
+
+  // Lockstep: consumers raise this (and futex wake it) to let the emulator run up to that frame number
+  _Atomic uint32_t frames_requested;
+
+  // Bit N set = chip8 key N held down by an external process
+  _Atomic uint16_t keypad_inject;
+
+  // CHIP8_SHM_CTRL_* flags set by an external process
+  _Atomic uint32_t control;
+
+  // Frame data (guarded by frame_seq)
+  uint32_t frame_count;
+  uint32_t display_width;
+  uint32_t display_height;
+  bool display[CHIP8_DISPLAY_WIDTH*CHIP8_DISPLAY_HEIGHT];
+  bool keypad[16];
+  uint8_t V[16];
+  uint16_t I;
+  uint16_t pc;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint8_t stack_depth;
+  uint16_t stack[12];
+
+} chip8_shm_t;
+
+
+// Many copies of the same ROM stored as a structure of arrays, each array is indexed by lane
+// Lane count is padded to CHIP8_BATCH_LANE_ALIGN so SIMD loops never need a scalar tail
+#define CHIP8_BATCH_LANE_ALIGN 32
+
+typedef struct
+{
+  uint32_t num_lanes;
+  uint32_t padded_lanes;
+
+  // Registers and timers, e.g. V[0x0F][lane] is VF of that lane
+  uint8_t*  V[16];
+  uint16_t* I;
+  uint16_t* pc;
+  uint8_t*  sp;
+  uint8_t*  delay_timer;
+  uint8_t*  sound_timer;
+
+  // Bit N set = key N pressed
+  uint16_t* keypad;
+
+  // Per lane random state so each lane can run with its own seed
+  uint32_t* rng_state;
+
+  uint16_t (*stack)[12];
+
+  // One bit per pixel, bit 63 of each row is the leftmost pixel
+  uint64_t (*display)[32];
+
+  // Every lane reads shared_ram until its first memory write, then gets a private copy
+  uint8_t** ram;
+  uint32_t private_lanes;
+  uint8_t shared_ram[4096];
+
+  // Scratch space used to group lanes that sit on the same PC
+  uint8_t* exec_mask;
+  int32_t* group_next;
+  int32_t group_head[4096];
+  uint16_t group_pcs[4096];
+
+  // Interpreter quirks (QUIRK_* bits), the same for every lane
+  uint32_t quirks;
+
+} chip8_batch_t;
+
+
+// Frame capture: the emulator copies each frame's display into a ring slot (2KB each), a writer thread expands and writes it
+#define CAPTURE_RING_SLOTS 256
+
+typedef struct
+{
+  bool display[CHIP8_DISPLAY_WIDTH*CHIP8_DISPLAY_HEIGHT];
+  uint32_t frame_number;
+} capture_slot_t;
+
+typedef struct
+{
+  capture_format_t format;
+  const char* path;
+  FILE* output_file;
+  bool dedup;
+  bool path_is_pattern;
+
+  // Output frame size and colors (expanded from the display using scale_factor, fg_color and bg_color)
+  uint32_t display_width;
+  uint32_t display_height;
+  uint32_t scale_factor;
+  uint32_t fg_color;
+  uint32_t bg_color;
+
+  // Single producer / single consumer ring, head is only written by the emulator, tail only by the writer
+  capture_slot_t* slots;
+  _Atomic uint32_t ring_head;
+  _Atomic uint32_t ring_tail;
+  sem_t frames_ready;
+  sem_t slots_free;
+  _Atomic bool stop_writer;
+
+  // Writer thread and its preallocated output buffer
+  pthread_t writer_thread;
+  uint8_t* frame_buffer;
+
+  // Emulator side bookkeeping
+  bool last_display[CHIP8_DISPLAY_WIDTH*CHIP8_DISPLAY_HEIGHT];
+  bool has_last_display;
+  uint32_t frame_number;
+  uint32_t frames_written;
+  uint32_t frames_deduped;
+  uint32_t frames_dropped;
+} capture_params_t;
+
+
+// Execution trace: one record per instruction in a ring buffer, written to a delta encoded file
+// File layout: TRACE_FILE_MAGIC, index of the first record (u64 LE), then a stream of blocks
+//   Keyframe: TRACE_TAG_KEYFRAME, full machine state before instruction <index> (see trace_write_keyframe)
+//   Record:   tag byte (TRACE_TAG_* bits below), opcode, then only the fields whose tag bit is set
+#define TRACE_FILE_MAGIC          "C8TRACE1"
+#define TRACE_KEYFRAME_INTERVAL   65536
+
+#define TRACE_TAG_PC        0x01    // PC is not the previous PC + 2
+#define TRACE_TAG_I         0x02
+#define TRACE_TAG_V         0x04    // Changed V mask (u16) + new values
+#define TRACE_TAG_MEM       0x08    // RAM write address (u16), length (u8) + values
+#define TRACE_TAG_SP        0x10
+#define TRACE_TAG_DELAY     0x20
+#define TRACE_TAG_SOUND     0x40
+#define TRACE_TAG_KEYFRAME  0x80
+
+typedef struct
+{
+  uint16_t pc;
+  uint16_t opcode;
+
+  // Values after the instruction ran (sp is the stack depth)
+  uint16_t I;
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+
+  // Changed V registers (bit N = VN) with their new values in data[], or RAM written by FX33/FX55 with the bytes in data[]
+  uint16_t changed_v;
+  uint16_t mem_addr;
+  uint8_t mem_len;
+  uint8_t data[16];
+} trace_record_t;
+
+typedef struct
+{
+  uint64_t index;
+  uint8_t ram[4096];
+  bool display[CHIP8_DISPLAY_WIDTH*CHIP8_DISPLAY_HEIGHT];
+  uint8_t V[16];
+  uint16_t I;
+  uint16_t pc;
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint16_t stack[12];
+} trace_keyframe_t;
+
+typedef struct
+{
+  bool active;
+  bool flight_recorder;
+  const char* path;
+  FILE* file;
+
+  // Record ring (capacity is a power of 2), head is the next instruction index, tail the next one to write out
+  trace_record_t* records;
+  uint32_t capacity;
+  _Atomic uint64_t head;
+  _Atomic uint64_t tail;
+
+  // Full state every keyframe_interval instructions (at most TRACE_KEYFRAME_INTERVAL, small rings get a few) so any point can be rebuilt from the nearest keyframe
+  trace_keyframe_t* keyframes;
+  uint32_t keyframe_interval;
+  uint32_t num_keyframe_slots;
+  _Atomic uint64_t keyframe_head;
+  uint64_t keyframe_tail;
+
+  // Streaming mode writer thread
+  pthread_t writer_thread;
+  _Atomic bool stop_writer;
+
+  // Encoder state: values the next record is delta encoded against
+  bool encoder_primed;
+  uint16_t prev_pc;
+  uint16_t prev_I;
+  uint8_t prev_sp;
+  uint8_t prev_delay_timer;
+  uint8_t prev_sound_timer;
+} trace_params_t;
+
+
+// Debugger: PC breakpoints, RAM/V register watchpoints and stepping
+#define DEBUG_MAX_WATCHPOINTS 16
+
+typedef enum
+{
+  STEP_NONE = 0,
+  STEP_INTO = 1,
+  STEP_OVER = 2
+} debug_step_t;
+
+typedef struct
+{
+  uint16_t start;
+  uint16_t end;     // Inclusive
+  bool on_read;
+  bool on_write;
+} debug_watchpoint_t;
+
+typedef struct
+{
+  // True when anything below is set, the main loop only takes the checked path while this is true
+  bool armed;
+
+  // One bit per RAM address
+  uint8_t pc_breakpoints[4096 / 8];
+  uint32_t num_pc_breakpoints;
+
+  debug_watchpoint_t ram_watchpoints[DEBUG_MAX_WATCHPOINTS];
+  uint32_t num_ram_watchpoints;
+
+  // Bit N set = break after VN is written / read
+  uint16_t v_watch_mask;
+  uint16_t v_read_watch_mask;
+
+  // Step into / over (step over runs a 2NNN call until it returns to step_over_pc at the same stack depth)
+  debug_step_t step_mode;
+  uint16_t step_over_pc;
+  uint16_t* step_over_stack_ptr;
+
+  // The breakpoint at the PC we stopped on is ignored once when resuming (keeps the checked path armed for that one instruction)
+  bool resuming;
+
+  // Instructions run through the tracer when it is active (NULL = no tracer)
+  trace_params_t* tracer;
+
+  // Stdin or TCP console (unfinished lines kept between frames, held back while a step runs)
+  // Commands are read from console_fd (-1 while no TCP client is connected), output goes to out
+  bool console;
+  int console_fd;
+  int listen_fd;
+  FILE* out;
+  bool console_waiting;
+  char console_line[256];
+  size_t console_line_len;
+} debugger_params_t;
+
+
+// Emulator side handle to the shared memory segment
+typedef struct
+{
+  chip8_shm_t* shm;
+  int shm_fd;
+  const char* shm_name;
+  uint16_t prev_keypad_inject;
+} shm_params_t;
+
+
+// ROM file mapped read-only, identified by the hash of its contents
+typedef struct
+{
+  const char* path;
+  const uint8_t* data;
+  size_t size;
+  uint64_t hash;
+} rom_file_t;
+
+
+// ROM library index file: header, then profiles sorted by rom_hash (binary searched straight from the mapping)
+// Records are fixed size and all fields little endian, read and written one field at a time (layout in chip8Emu_library.c)
+#define ROM_LIBRARY_MAGIC         "C8ROMLIB"
+#define ROM_LIBRARY_VERSION       1u
+#define ROM_LIBRARY_HEADER_SIZE   16
+#define ROM_LIBRARY_PROFILE_SIZE  144
+
+// One profile as used in memory (decoded from / encoded to a ROM_LIBRARY_PROFILE_SIZE record)
+typedef struct
+{
+  uint64_t rom_hash;
+  uint32_t platform;
+  uint32_t quirks;
+  uint32_t instructions_per_second;
+  uint32_t fg_color;
+  uint32_t bg_color;
+  int32_t keymap[16];
+  char title[48];
+
+  // Render settings (scale 0 = none stored, keep the defaults)
+  uint8_t scale_factor;
+  uint8_t render_filter;
+} rom_profile_t;
+
+typedef struct
+{
+  void* map;
+  size_t map_size;
+  uint32_t num_profiles;
+  const uint8_t* profiles;    // First profile record in the mapping
+} rom_library_t;
+
+
+// One line of an input script: from frame on, lane (or every lane if negative) holds down keys (bit N = key N)
+typedef struct
+{
+  uint32_t frame;
+  int32_t lane;
+  uint16_t keys;
+  uint32_t line;
+} input_event_t;
+
+
 
 /*
  *
@@ -85,14 +626,23 @@ typedef struct
  * 
  */
 
-// Initialize user configuration settings received from the CLI
+// Initialize user configuration settings from the defaults, an optional config file and the CLI (in that order)
 bool init_user_configuration(user_config_params_t* cfg_params, int num_args, char** args_array);
 
+// Load an input script ("FRAME LANE KEYS" lines for lanes below num_lanes or *), sorted by frame (NULL on error)
+input_event_t* load_input_script(const char* path, uint32_t num_lanes, uint32_t* num_events);
+
 // Run once to initialize the SDL parameters (return true if initialized)
 bool init_sdl(sdl_params_t* sdl_parameters, user_config_params_t config_parameters);
 
-// Initialize an instance of a chip8
-bool init_chip8(chip8_t* c8, const char rom_name[]);
+// Create the window, renderer, title font and render filter for these settings (SDL and SDL_ttf already initialized, return true if created)
+bool create_sdl_window(sdl_params_t* sdl_parameters, user_config_params_t* cfg);
+
+// Destroy the window, renderer, font and render filter created by init_sdl / create_sdl_window
+void close_sdl(sdl_params_t* sdl_parameters);
+
+// Initialize an instance of a chip8 running a mapped ROM
+bool init_chip8(chip8_t* c8, rom_file_t* rom);
 
 // Clear window to the background color
 void clear_window(sdl_params_t* sdl_parameters, user_config_params_t* cfg_params);
@@ -108,7 +658,7 @@ void clear_window(sdl_params_t* sdl_parameters, user_config_params_t* cfg_params
  */
 
 // Get User Input
-void handle_user_input(chip8_t* c8);
+void handle_user_input(chip8_t* c8, user_config_params_t* cfg, debugger_params_t* dbg, input_latency_t* latency);
 
 // Emulate Chip8 Instructions
 void emulate_instructions(chip8_t* c8, user_config_params_t* cfg);
@@ -119,4 +669,260 @@ void update_window(sdl_params_t* sdl_params, user_config_params_t* cfg, chip8_t*
 // Update chip8 timers
 void update_timers(chip8_t* c8);
 
-#endif
\ No newline at end of file
+// Sleep until the performance counter reaches target (spins only for the last ~100 us)
+void wait_until(uint64_t target_counter);
+
+// Sleep until the next 60Hz frame deadline and advance it (deadline 0 starts pacing from now)
+void wait_for_frame_deadline(uint64_t* frame_deadline);
+
+// Take a latency sample if a key press is waiting for this frame to be presented
+void record_input_latency(input_latency_t* latency);
+
+// Print the input-to-present latency summary
+void report_input_latency(input_latency_t* latency);
+
+// Hash the display, RAM, registers, timers and stack (same state always gives the same hash)
+uint64_t hash_chip8_state(chip8_t* c8);
+
+// Random state for a seed (xorshift must never start at 0)
+uint32_t chip8_random_seed(uint32_t seed);
+
+// Next CXNN random byte, advances the xorshift32 state
+uint8_t chip8_random_byte(uint32_t* rng_state);
+
+
+
+/*
+ *
+ *
+ *    SHARED MEMORY INTERFACE FUNCTIONS
+ *
+ * 
+ */
+
+// Create and map the shared memory segment (return true if initialized)
+bool init_shared_memory(shm_params_t* shm_params, user_config_params_t* cfg);
+
+// Lockstep: wait (briefly) for a consumer to request the next frame, return true if one was requested (or quit was)
+bool shared_memory_await_frame(shm_params_t* shm_params);
+
+// True once an external process has set CHIP8_SHM_CTRL_QUIT
+bool shared_memory_quit_requested(shm_params_t* shm_params);
+
+// Apply keys and control flags written by external processes
+void shared_memory_apply_input(shm_params_t* shm_params, chip8_t* c8);
+
+// Publish the current frame and machine state to external processes
+void shared_memory_publish_frame(shm_params_t* shm_params, chip8_t* c8);
+
+// Unmap and remove the shared memory segment
+void close_shared_memory(shm_params_t* shm_params);
+
+
+
+/*
+ *
+ *
+ *    BATCH (MANY INSTANCES) FUNCTIONS
+ *
+ * 
+ */
+
+// Allocate num_lanes copies of a chip8 all running rom, lane N is seeded with seed + N
+bool init_chip8_batch(chip8_batch_t* batch, uint32_t num_lanes, rom_file_t* rom, uint32_t seed);
+
+// Emulate one instruction on every lane
+void emulate_batch_instructions(chip8_batch_t* batch);
+
+// Set the keys held down on one lane (bit N = key N)
+void set_batch_lane_keys(chip8_batch_t* batch, uint32_t lane, uint16_t keys);
+
+// Update the timers of every lane
+void update_batch_timers(chip8_batch_t* batch);
+
+// Free everything allocated by init_chip8_batch
+void free_chip8_batch(chip8_batch_t* batch);
+
+// Run the ROM on cfg->batch_lanes lanes for cfg->batch_frames frames without a window, report throughput and each lane's state hash
+bool run_chip8_batch(user_config_params_t* cfg, rom_file_t* rom, uint32_t seed);
+
+
+
+/*
+ *
+ *
+ *    FRAME CAPTURE FUNCTIONS
+ *
+ * 
+ */
+
+// Open the capture output and start the writer thread (return true if initialized)
+bool init_capture(capture_params_t* capture_params, user_config_params_t* cfg);
+
+// Queue the current frame for the writer thread (dropped if the ring is full, emulation never waits for the disk)
+void capture_frame(capture_params_t* capture_params, chip8_t* c8);
+
+// Flush queued frames, stop the writer thread and close the output
+void close_capture(capture_params_t* capture_params);
+
+// Write an RGBA image as an (uncompressed) PNG file
+bool write_png_rgba(const char* path, const uint8_t* rgba, uint32_t width, uint32_t height);
+
+// Write the current display as a PNG using the configured scale and colors
+bool write_display_png(const char* path, user_config_params_t* cfg, chip8_t* c8);
+
+// Write a PNG marking where the display differs from a reference PNG written by chip8Emu (missing pixels red, extra ones green)
+bool write_display_diff_png(const char* reference_path, const char* path, user_config_params_t* cfg, chip8_t* c8);
+
+
+
+/*
+ *
+ *
+ *    DEBUGGER FUNCTIONS
+ *
+ * 
+ */
+
+// Set up the debugger from the user configuration (false if the TCP console port could not be opened)
+bool init_debugger(debugger_params_t* dbg, user_config_params_t* cfg);
+
+// Close the TCP console
+void close_debugger(debugger_params_t* dbg);
+
+// Checked version of the per frame instruction loop, stops early (state DEBUG_BREAK) on a breakpoint, watchpoint or finished step
+void debug_emulate_instructions(debugger_params_t* dbg, chip8_t* c8, user_config_params_t* cfg, uint32_t num_instructions);
+
+// Stop emulation and show where we are
+void debug_break(debugger_params_t* dbg, chip8_t* c8, const char* reason);
+
+// Leave DEBUG_BREAK, optionally stepping a single instruction (into or over)
+void debug_resume(debugger_params_t* dbg, chip8_t* c8, debug_step_t step_mode);
+
+// Toggle a breakpoint at addr
+void debug_toggle_breakpoint(debugger_params_t* dbg, uint16_t addr);
+
+// Print registers, timers and the subroutine stack
+void debug_print_registers(debugger_params_t* dbg, chip8_t* c8);
+
+// Accept a TCP console client, then read and run any complete commands typed on the console
+void debug_poll_console(debugger_params_t* dbg, chip8_t* c8);
+
+
+
+/*
+ *
+ *
+ *    EXECUTION TRACE FUNCTIONS
+ *
+ * 
+ */
+
+// Allocate the trace ring and, when streaming, open the file and start the writer thread (return true if initialized)
+bool init_tracer(trace_params_t* tracer, user_config_params_t* cfg);
+
+// Emulate one instruction and record what it changed
+void trace_emulate_instruction(trace_params_t* tracer, chip8_t* c8, user_config_params_t* cfg);
+
+// Flight recorder: write the instructions currently held in memory to the trace file
+void trace_dump(trace_params_t* tracer);
+
+// Stop the writer thread (or dump the flight recorder) and free the ring
+void close_tracer(trace_params_t* tracer);
+
+
+
+/*
+ *
+ *
+ *    ROM LIBRARY FUNCTIONS
+ *
+ * 
+ */
+
+// Map a ROM file read-only and hash its contents (return true if mapped)
+bool map_rom_file(rom_file_t* rom, const char* path);
+
+// Unmap a ROM mapped by map_rom_file
+void unmap_rom_file(rom_file_t* rom);
+
+// Map a library index file (return false if it is missing or not a valid index)
+bool open_rom_library(rom_library_t* library, const char* path);
+
+// Binary search the library for a ROM hash and decode its profile (false if there is none)
+bool find_rom_profile(rom_library_t* library, uint64_t rom_hash, rom_profile_t* profile);
+
+// Unmap a library opened by open_rom_library
+void close_rom_library(rom_library_t* library);
+
+// Apply the library profile for this ROM, if any, to every setting not given on the command line
+void apply_rom_profile(user_config_params_t* cfg, rom_file_t* rom);
+
+// Store the current settings as this ROM's profile (return true if the index was written)
+bool save_rom_profile(user_config_params_t* cfg, rom_file_t* rom);
+
+// Default quirk set of a platform
+uint32_t platform_default_quirks(rom_platform_t platform);
+
+// Short name of a platform as used by --platform
+const char* platform_name(rom_platform_t platform);
+
+
+
+/*
+ *
+ *
+ *    RENDER FILTER FUNCTIONS
+ *
+ * 
+ */
+
+// Allocate the scaler buffers and the streaming texture the filtered frame goes into (return true if initialized)
+bool init_render_filter(sdl_params_t* sdl_params, user_config_params_t* cfg);
+
+// Filter the display into the frame texture and copy it to the window (one texture upload per frame)
+void render_filtered_frame(sdl_params_t* sdl_params, user_config_params_t* cfg, chip8_t* c8);
+
+// Free everything allocated by init_render_filter
+void free_render_filter(sdl_params_t* sdl_params);
+
+// Short name of a filter as used by --filter
+const char* render_filter_name(render_filter_t filter);
+
+
+
+/*
+ *
+ *
+ *    AUTOTUNE FUNCTIONS
+ *
+ * 
+ */
+
+// Measure interpreter and render cost on this host, pick IPS, scale and filter for 60 fps and save them as the ROM's profile
+bool run_autotune(user_config_params_t* cfg, rom_file_t* rom);
+
+
+
+
+/*
+ *
+ *
+ *    VIP TIMING FUNCTIONS
+ *
+ * 
+ */
+
+// Start a frame from the previous frame's carry (the overrun already spent)
+void vip_begin_frame(vip_timing_t* timing);
+
+// Run instructions until frame_cycles reaches cycle_target, a sprite draw waits for the display or emulation stops
+void emulate_vip_cycles(vip_timing_t* timing, chip8_t* c8, user_config_params_t* cfg, debugger_params_t* dbg, trace_params_t* tracer, uint32_t cycle_target);
+
+// End a frame: carry its overrun into the next one and count the instructions it ran
+void vip_end_frame(vip_timing_t* timing);
+
+// Print the instructions per frame the VIP timing model ran
+void report_vip_timing(vip_timing_t* timing);
+
+#endif
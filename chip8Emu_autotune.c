@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "chip8Emu.h"
+
+// Autotune: time the interpreter on this ROM and update_window at each candidate scale and filter (in a hidden window),
+// then take the largest, best looking setting that still leaves room for enough instructions inside the frame budget
+
+// Calibration lengths: long enough to average out timer noise, short enough not to hold up start up
+#define AUTOTUNE_INTERPRETER_MS       250
+#define AUTOTUNE_BLOCK_INSTRUCTIONS   1000
+#define AUTOTUNE_RENDER_WARMUP        5
+#define AUTOTUNE_RENDER_FRAMES        30
+
+// Render settings are only traded for more than this many instructions per second (the original fixed rate)
+#define AUTOTUNE_MIN_IPS              500
+
+// Desktop share the window may take
+#define AUTOTUNE_DESKTOP_PERCENT      90
+
+// Candidates in order of preference
+static const uint32_t autotune_scales[] = {20, 15, 12, 10, 8, 6, 4, 2};
+static const render_filter_t autotune_filters[] = {RENDER_SCALE2X, RENDER_NEAREST, RENDER_RECTS};
+
+
+
+// Host nanoseconds per emulated instruction for this ROM (0 if it could not run)
+static double measure_interpreter(user_config_params_t* cfg, rom_file_t* rom, chip8_t* c8)
+{
+  if (!init_chip8(c8, rom))
+    return 0;
+
+  const uint64_t frequency = SDL_GetPerformanceFrequency();
+  const uint64_t start = SDL_GetPerformanceCounter();
+  const uint64_t end = start + frequency * AUTOTUNE_INTERPRETER_MS / 1000;
+  uint64_t now = start;
+  uint64_t instructions = 0;
+
+  // Timers tick between blocks so delay loops keep moving like they do in the main loop
+  while (now < end)
+  {
+    for (uint32_t i=0; i<AUTOTUNE_BLOCK_INSTRUCTIONS; i++)
+      emulate_instructions(c8, cfg);
+
+    update_timers(c8);
+    instructions += AUTOTUNE_BLOCK_INSTRUCTIONS;
+    now = SDL_GetPerformanceCounter();
+  }
+
+  return (double)(now - start) * 1e9 / frequency / instructions;
+}
+
+
+// Milliseconds update_window takes per frame with these settings, drawn in a hidden window (negative if it could not open)
+// SDL and SDL_ttf are initialized once by run_autotune, each trial only creates its own window, and the font is loaded before timing starts
+static double measure_render(user_config_params_t* cfg, chip8_t* c8)
+{
+  sdl_params_t sdl_parameters = {0};
+  if (!create_sdl_window(&sdl_parameters, cfg))
+  {
+    close_sdl(&sdl_parameters);
+    return -1;
+  }
+
+  uint64_t start = 0;
+  for (uint32_t frame=0; frame<AUTOTUNE_RENDER_WARMUP + AUTOTUNE_RENDER_FRAMES; frame++)
+  {
+    if (frame == AUTOTUNE_RENDER_WARMUP)
+      start = SDL_GetPerformanceCounter();
+
+    update_window(&sdl_parameters, cfg, c8);
+  }
+
+  const double render_ms = (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency() / AUTOTUNE_RENDER_FRAMES;
+
+  close_sdl(&sdl_parameters);
+  return render_ms;
+}
+
+
+// Measure interpreter and render cost on this host, pick IPS, scale and filter for 60 fps and save them as the ROM's profile
+bool run_autotune(user_config_params_t* cfg, rom_file_t* rom)
+{
+  // The machine the render passes draw is the one left after the interpreter pass, so the display has real content
+  chip8_t* c8 = calloc(1, sizeof(chip8_t));
+  if (c8 == NULL)
+    return false;
+
+  const double ns_per_instruction = measure_interpreter(cfg, rom, c8);
+  if (ns_per_instruction <= 0)
+  {
+    free(c8);
+    return false;
+  }
+
+  // Settings given on the command line are kept and the rest is tuned around them (config file values are only defaults)
+  const double frame_budget_ms = 1000.0 / 60 * (100 - cfg->autotune_headroom) / 100;
+  const uint32_t max_ips = (cfg->cli_set & CFG_SET_IPS) ? cfg->instructions_per_second : cfg->autotune_max_ips;
+  const uint32_t min_ips = (max_ips < AUTOTUNE_MIN_IPS) ? max_ips : AUTOTUNE_MIN_IPS;
+  const double min_interpreter_ms = min_ips / 60.0 * ns_per_instruction / 1e6;
+
+  double render_ms = 0;
+
+  if (!cfg->headless)
+  {
+    if (SDL_Init(SDL_INIT_VIDEO) != 0 || TTF_Init() == -1)
+    {
+      SDL_Log("Could not init SDL stuff ... exiting! %s\n", SDL_GetError());
+      free(c8);
+      return false;
+    }
+
+    SDL_DisplayMode desktop = {0};
+    const bool have_desktop = (SDL_GetCurrentDisplayMode(0, &desktop) == 0);
+
+    bool found = false;
+    uint32_t cheapest_scale = cfg->scale_factor;
+    render_filter_t cheapest_filter = cfg->render_filter;
+    double cheapest_ms = -1;
+
+    const uint32_t num_scales = (cfg->cli_set & CFG_SET_SCALE) ? 1 : sizeof(autotune_scales) / sizeof(autotune_scales[0]);
+    const uint32_t num_filters = (cfg->cli_set & CFG_SET_FILTER) ? 1 : sizeof(autotune_filters) / sizeof(autotune_filters[0]);
+
+    for (uint32_t s=0; s<num_scales && !found; s++)
+    {
+      const uint32_t scale = (cfg->cli_set & CFG_SET_SCALE) ? cfg->scale_factor : autotune_scales[s];
+      const uint32_t window_w = (cfg->window_width + cfg->side_border + cfg->side_border) * scale;
+      const uint32_t window_h = (cfg->window_height + cfg->top_border + cfg->side_border) * scale;
+
+      if (!(cfg->cli_set & CFG_SET_SCALE) && have_desktop &&
+          (window_w * 100 > (uint32_t)desktop.w * AUTOTUNE_DESKTOP_PERCENT || window_h * 100 > (uint32_t)desktop.h * AUTOTUNE_DESKTOP_PERCENT))
+        continue;
+
+      for (uint32_t f=0; f<num_filters && !found; f++)
+      {
+        user_config_params_t trial = *cfg;
+        trial.scale_factor = scale;
+        trial.render_filter = (cfg->cli_set & CFG_SET_FILTER) ? cfg->render_filter : autotune_filters[f];
+        trial.hidden_window = true;
+
+        // Phosphor glow cannot be drawn with rectangles
+        if (trial.phosphor_decay != 0 && trial.render_filter == RENDER_RECTS)
+          continue;
+
+        const double trial_ms = measure_render(&trial, c8);
+        if (trial_ms < 0)
+          continue;
+
+        SDL_Log("Autotune: scale %u %s: %.3f ms/frame", (unsigned int)scale, render_filter_name(trial.render_filter), trial_ms);
+
+        if (cheapest_ms < 0 || trial_ms < cheapest_ms)
+        {
+          cheapest_ms = trial_ms;
+          cheapest_scale = scale;
+          cheapest_filter = trial.render_filter;
+        }
+
+        // First fit in preference order wins
+        if (trial_ms + min_interpreter_ms <= frame_budget_ms)
+        {
+          found = true;
+          cfg->scale_factor = scale;
+          cfg->render_filter = trial.render_filter;
+          render_ms = trial_ms;
+        }
+      }
+    }
+
+    if (cheapest_ms < 0)
+    {
+      SDL_Log("Autotune: could not open a window to measure rendering");
+      free(c8);
+      return false;
+    }
+
+    // Nothing fits: the cheapest setting at least stutters the least
+    if (!found)
+    {
+      SDL_Log("Autotune: no setting sustains 60 fps with %u%% headroom, using the cheapest", (unsigned int)cfg->autotune_headroom);
+      cfg->scale_factor = cheapest_scale;
+      cfg->render_filter = cheapest_filter;
+      render_ms = cheapest_ms;
+    }
+  }
+
+  // Whatever is left of the frame budget goes to instructions
+  if (!(cfg->cli_set & CFG_SET_IPS))
+  {
+    const double spare_ms = frame_budget_ms - render_ms;
+    const double affordable_ips = (spare_ms > 0) ? spare_ms * 1e6 / ns_per_instruction * 60 : 0;
+
+    uint32_t ips = (affordable_ips < max_ips) ? (uint32_t)affordable_ips : max_ips;
+    ips -= ips % 10;
+    cfg->instructions_per_second = (ips < 60) ? 60 : ips;
+  }
+
+  SDL_Log("Autotune: %.1f ns/instruction, %.3f ms/frame render -> %u IPS, scale %u, %s (%.0f%% of the frame)",
+          ns_per_instruction, render_ms, (unsigned int)cfg->instructions_per_second, (unsigned int)cfg->scale_factor,
+          render_filter_name(cfg->render_filter),
+          100 * (render_ms + cfg->instructions_per_second / 60.0 * ns_per_instruction / 1e6) * 60 / 1000);
+
+  free(c8);
+
+  if (cfg->library_path == NULL)
+  {
+    SDL_Log("Autotune: no ROM library (--no-library), the result is only used for this run");
+    return true;
+  }
+
+  return save_rom_profile(cfg, rom);
+}
@@ -0,0 +1,634 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "chip8Emu.h"
+
+// Pick the widest lane vector the compiler was told it may use (build with -mavx2 for AVX2)
+// Every lane array is CHIP8_BATCH_LANE_ALIGN bytes aligned and padded, so all widths divide it evenly
+#if defined(__AVX2__)
+  #include <immintrin.h>
+  typedef __m256i lane_vec_t;
+  #define LANE_VEC_WIDTH 32
+
+  static inline lane_vec_t vec_load(const uint8_t* p)             { return _mm256_load_si256((const __m256i*)p); }
+  static inline void vec_store(uint8_t* p, lane_vec_t v)          { _mm256_store_si256((__m256i*)p, v); }
+  static inline lane_vec_t vec_set1(uint8_t x)                    { return _mm256_set1_epi8((char)x); }
+  static inline lane_vec_t vec_add(lane_vec_t a, lane_vec_t b)    { return _mm256_add_epi8(a, b); }
+  static inline lane_vec_t vec_adds(lane_vec_t a, lane_vec_t b)   { return _mm256_adds_epu8(a, b); }
+  static inline lane_vec_t vec_sub(lane_vec_t a, lane_vec_t b)    { return _mm256_sub_epi8(a, b); }
+  static inline lane_vec_t vec_subs(lane_vec_t a, lane_vec_t b)   { return _mm256_subs_epu8(a, b); }
+  static inline lane_vec_t vec_and(lane_vec_t a, lane_vec_t b)    { return _mm256_and_si256(a, b); }
+  static inline lane_vec_t vec_or(lane_vec_t a, lane_vec_t b)     { return _mm256_or_si256(a, b); }
+  static inline lane_vec_t vec_xor(lane_vec_t a, lane_vec_t b)    { return _mm256_xor_si256(a, b); }
+  static inline lane_vec_t vec_max(lane_vec_t a, lane_vec_t b)    { return _mm256_max_epu8(a, b); }
+  static inline lane_vec_t vec_cmpeq(lane_vec_t a, lane_vec_t b)  { return _mm256_cmpeq_epi8(a, b); }
+  static inline lane_vec_t vec_srl1(lane_vec_t a)                 { return _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F)); }
+  static inline lane_vec_t vec_blend(lane_vec_t a, lane_vec_t b, lane_vec_t m) { return _mm256_blendv_epi8(a, b, m); }
+
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+  typedef __m128i lane_vec_t;
+  #define LANE_VEC_WIDTH 16
+
+  static inline lane_vec_t vec_load(const uint8_t* p)             { return _mm_load_si128((const __m128i*)p); }
+  static inline void vec_store(uint8_t* p, lane_vec_t v)          { _mm_store_si128((__m128i*)p, v); }
+  static inline lane_vec_t vec_set1(uint8_t x)                    { return _mm_set1_epi8((char)x); }
+  static inline lane_vec_t vec_add(lane_vec_t a, lane_vec_t b)    { return _mm_add_epi8(a, b); }
+  static inline lane_vec_t vec_adds(lane_vec_t a, lane_vec_t b)   { return _mm_adds_epu8(a, b); }
+  static inline lane_vec_t vec_sub(lane_vec_t a, lane_vec_t b)    { return _mm_sub_epi8(a, b); }
+  static inline lane_vec_t vec_subs(lane_vec_t a, lane_vec_t b)   { return _mm_subs_epu8(a, b); }
+  static inline lane_vec_t vec_and(lane_vec_t a, lane_vec_t b)    { return _mm_and_si128(a, b); }
+  static inline lane_vec_t vec_or(lane_vec_t a, lane_vec_t b)     { return _mm_or_si128(a, b); }
+  static inline lane_vec_t vec_xor(lane_vec_t a, lane_vec_t b)    { return _mm_xor_si128(a, b); }
+  static inline lane_vec_t vec_max(lane_vec_t a, lane_vec_t b)    { return _mm_max_epu8(a, b); }
+  static inline lane_vec_t vec_cmpeq(lane_vec_t a, lane_vec_t b)  { return _mm_cmpeq_epi8(a, b); }
+  static inline lane_vec_t vec_srl1(lane_vec_t a)                 { return _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7F)); }
+  static inline lane_vec_t vec_blend(lane_vec_t a, lane_vec_t b, lane_vec_t m) { return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a)); }
+
+#else
+  // Portable fallback: one lane at a time, same kernels
+  typedef uint8_t lane_vec_t;
+  #define LANE_VEC_WIDTH 1
+
+  static inline lane_vec_t vec_load(const uint8_t* p)             { return *p; }
+  static inline void vec_store(uint8_t* p, lane_vec_t v)          { *p = v; }
+  static inline lane_vec_t vec_set1(uint8_t x)                    { return x; }
+  static inline lane_vec_t vec_add(lane_vec_t a, lane_vec_t b)    { return (uint8_t)(a + b); }
+  static inline lane_vec_t vec_adds(lane_vec_t a, lane_vec_t b)   { return (a + b > 0xFF) ? 0xFF : (uint8_t)(a + b); }
+  static inline lane_vec_t vec_sub(lane_vec_t a, lane_vec_t b)    { return (uint8_t)(a - b); }
+  static inline lane_vec_t vec_subs(lane_vec_t a, lane_vec_t b)   { return (a > b) ? (uint8_t)(a - b) : 0; }
+  static inline lane_vec_t vec_and(lane_vec_t a, lane_vec_t b)    { return a & b; }
+  static inline lane_vec_t vec_or(lane_vec_t a, lane_vec_t b)     { return a | b; }
+  static inline lane_vec_t vec_xor(lane_vec_t a, lane_vec_t b)    { return a ^ b; }
+  static inline lane_vec_t vec_max(lane_vec_t a, lane_vec_t b)    { return (a > b) ? a : b; }
+  static inline lane_vec_t vec_cmpeq(lane_vec_t a, lane_vec_t b)  { return (a == b) ? 0xFF : 0x00; }
+  static inline lane_vec_t vec_srl1(lane_vec_t a)                 { return a >> 1; }
+  static inline lane_vec_t vec_blend(lane_vec_t a, lane_vec_t b, lane_vec_t m) { return (b & m) | (a & ~m); }
+#endif
+
+
+// Groups smaller than padded_lanes / BATCH_SIMD_GROUP_DIVISOR run lane by lane instead of through the masked SIMD kernels
+#define BATCH_SIMD_GROUP_DIVISOR 8
+
+
+
+// Allocate a zeroed lane array, rounded up to the SIMD alignment
+static void* batch_alloc(size_t size)
+{
+  size = (size + CHIP8_BATCH_LANE_ALIGN - 1) & ~(size_t)(CHIP8_BATCH_LANE_ALIGN - 1);
+
+  void* ptr = aligned_alloc(CHIP8_BATCH_LANE_ALIGN, size);
+  if (ptr != NULL)
+    memset(ptr, 0, size);
+
+  return ptr;
+}
+
+
+// RAM a lane reads from
+static inline uint8_t* batch_lane_ram(chip8_batch_t* batch, uint32_t lane)
+{
+  return (batch->ram[lane] != NULL) ? batch->ram[lane] : batch->shared_ram;
+}
+
+
+// RAM a lane writes to (copy the shared image on the first write, NULL if out of memory)
+static uint8_t* batch_lane_ram_for_write(chip8_batch_t* batch, uint32_t lane)
+{
+  if (batch->ram[lane] == NULL)
+  {
+    batch->ram[lane] = malloc(sizeof(batch->shared_ram));
+    if (batch->ram[lane] == NULL)
+    {
+      SDL_Log("Out of memory for lane %u RAM ... dropping write", (unsigned int)lane);
+      return NULL;
+    }
+
+    memcpy(batch->ram[lane], batch->shared_ram, sizeof(batch->shared_ram));
+    batch->private_lanes++;
+  }
+
+  return batch->ram[lane];
+}
+
+
+// Opcode at pc as seen by a lane
+static inline uint16_t batch_lane_opcode(chip8_batch_t* batch, uint32_t lane, uint16_t pc)
+{
+  const uint8_t* ram = batch_lane_ram(batch, lane);
+  return (ram[pc] << 8) | ram[(pc + 1) & 0x0FFF];
+}
+
+
+// Allocate num_lanes copies of a chip8 all running rom_name, lane N is seeded with seed + N
+bool init_chip8_batch(chip8_batch_t* batch, uint32_t num_lanes, rom_file_t* rom, uint32_t seed)
+{
+  memset(batch, 0, sizeof(*batch));
+
+  // Load the font and ROM once through the regular single instance path
+  chip8_t* template_c8 = calloc(1, sizeof(chip8_t));
+  if (template_c8 == NULL || !init_chip8(template_c8, rom))
+  {
+    free(template_c8);
+    return false;
+  }
+
+  memcpy(batch->shared_ram, template_c8->emu_ram, sizeof(batch->shared_ram));
+
+  batch->num_lanes = num_lanes;
+  batch->padded_lanes = (num_lanes + CHIP8_BATCH_LANE_ALIGN - 1) & ~(uint32_t)(CHIP8_BATCH_LANE_ALIGN - 1);
+  const uint32_t lanes = batch->padded_lanes;
+
+  bool allocated = true;
+  for (uint8_t i=0; i<16; i++)
+  {
+    batch->V[i] = batch_alloc(lanes * sizeof(uint8_t));
+    allocated &= (batch->V[i] != NULL);
+  }
+
+  batch->I = batch_alloc(lanes * sizeof(uint16_t));
+  batch->pc = batch_alloc(lanes * sizeof(uint16_t));
+  batch->sp = batch_alloc(lanes * sizeof(uint8_t));
+  batch->delay_timer = batch_alloc(lanes * sizeof(uint8_t));
+  batch->sound_timer = batch_alloc(lanes * sizeof(uint8_t));
+  batch->keypad = batch_alloc(lanes * sizeof(uint16_t));
+  batch->rng_state = batch_alloc(lanes * sizeof(uint32_t));
+  batch->stack = batch_alloc(lanes * sizeof(batch->stack[0]));
+  batch->display = batch_alloc(lanes * sizeof(batch->display[0]));
+  batch->ram = batch_alloc(lanes * sizeof(uint8_t*));
+  batch->exec_mask = batch_alloc(lanes * sizeof(uint8_t));
+  batch->group_next = batch_alloc(lanes * sizeof(int32_t));
+
+  allocated &= batch->I && batch->pc && batch->sp && batch->delay_timer && batch->sound_timer && batch->keypad;
+  allocated &= batch->rng_state && batch->stack && batch->display && batch->ram && batch->exec_mask && batch->group_next;
+
+  if (!allocated)
+  {
+    SDL_Log("Could not allocate %u chip8 lanes", (unsigned int)num_lanes);
+    free(template_c8);
+    free_chip8_batch(batch);
+    return false;
+  }
+
+  // Padding lanes stay zeroed and are never stepped
+  for (uint32_t l=0; l<num_lanes; l++)
+  {
+    batch->pc[l] = template_c8->emu_pc;
+
+    // Same generator and seed as a single instance run with --seed (seed + l)
+    batch->rng_state[l] = chip8_random_seed(seed + l);
+  }
+
+  for (uint32_t pc=0; pc<4096; pc++)
+    batch->group_head[pc] = -1;
+
+  free(template_c8);
+  return true;
+}
+
+
+// Emulate one instruction on a single lane (same behaviour as emulate_instructions)
+static void batch_execute_lane(chip8_batch_t* batch, uint32_t lane, uint16_t inst_opcode)
+{
+  uint16_t inst_nnn = inst_opcode & 0x0FFF;
+  uint8_t  inst_nn  = inst_opcode & 0x00FF;
+  uint8_t  inst_n   = inst_opcode & 0x000F;
+  uint8_t  inst_x   = (inst_opcode & 0x0F00) >> 8;
+  uint8_t  inst_y   = (inst_opcode & 0x00F0) >> 4;
+  uint8_t  inst_op  = (inst_opcode & 0xF000) >> 12;
+
+  uint8_t* vx = &batch->V[inst_x][lane];
+  uint8_t* vy = &batch->V[inst_y][lane];
+  uint8_t* vf = &batch->V[0x0F][lane];
+  uint16_t* pc = &batch->pc[lane];
+  uint16_t* reg_I = &batch->I[lane];
+
+  *pc += 2;
+
+  switch (inst_op)
+  {
+    case 0x00:
+    {
+      if (inst_nn == 0xE0)        // 00E0: Clear Screen
+        memset(batch->display[lane], 0, sizeof(batch->display[0]));
+
+      else if (inst_nn == 0xEE && batch->sp[lane] > 0)   // 00EE: Return from subroutine
+        *pc = batch->stack[lane][--batch->sp[lane]];
+
+      break;
+    }
+
+    case 0x01:  *pc = inst_nnn;  break;     // 1NNN: Jump to Address NNN
+
+    case 0x02:        // 2NNN: Call Subroutine at MemoryAddr NNN
+    {
+      if (batch->sp[lane] < 12)
+        batch->stack[lane][batch->sp[lane]++] = *pc;
+
+      *pc = inst_nnn;
+      break;
+    }
+
+    case 0x03:  *pc += (*vx == inst_nn) ? 2 : 0;  break;                      // 3XNN: Skip if V[X] == NN
+    case 0x04:  *pc += (*vx != inst_nn) ? 2 : 0;  break;                      // 4XNN: Skip if V[X] != NN
+    case 0x05:  *pc += (inst_n == 0 && *vx == *vy) ? 2 : 0;  break;           // 5XY0: Skip if V[X] == V[Y]
+    case 0x06:  *vx = inst_nn;  break;                                        // 6XNN: VX = NN
+    case 0x07:  *vx += inst_nn;  break;                                       // 7XNN: VX += NN
+
+    case 0x08:
+    {
+      // Flag producing ops take the flag from the original operands and write VF last (matches emulate_instructions when X is F)
+      const uint8_t source = (batch->quirks & QUIRK_SHIFT_USES_VY) ? *vy : *vx;
+      uint8_t flag;
+
+      if (inst_n == 0x00)       *vx = *vy;
+      else if (inst_n == 0x01)  *vx |= *vy;
+      else if (inst_n == 0x02)  *vx &= *vy;
+      else if (inst_n == 0x03)  *vx ^= *vy;
+      else if (inst_n == 0x04)  { flag = (*vx + *vy > 255);  *vx += *vy;  *vf = flag; }
+      else if (inst_n == 0x05)  { flag = (*vx >= *vy);  *vx -= *vy;  *vf = flag; }
+      else if (inst_n == 0x06)  { *vx = source >> 1;  *vf = source & 0x01; }
+      else if (inst_n == 0x07)  { flag = (*vy >= *vx);  *vx = *vy - *vx;  *vf = flag; }
+      else if (inst_n == 0x0E)  { *vx = source << 1;  *vf = (source & 0x80) >> 7; }
+
+      if ((batch->quirks & QUIRK_VF_RESET) && inst_n >= 0x01 && inst_n <= 0x03)
+        *vf = 0;
+      break;
+    }
+
+    case 0x09:  *pc += (*vx != *vy) ? 2 : 0;  break;                          // 9XY0: Skip if VX != VY
+    case 0x0A:  *reg_I = inst_nnn;  break;                                    // ANNN: I = NNN
+    case 0x0B:  *pc = batch->V[(batch->quirks & QUIRK_JUMP_VX) ? inst_x : 0][lane] + inst_nnn;  break;   // BNNN: Jump to V0 + NNN (BXNN quirk: VX)
+    case 0x0C:  *vx = chip8_random_byte(&batch->rng_state[lane]) & inst_nn;  break;   // CXNN: VX = rand() & NN
+
+    case 0x0D:      // DXYN: Draw N height Sprite at Coordinate XY (rows are 64 bit masks)
+    {
+      const uint8_t* ram = batch_lane_ram(batch, lane);
+      const uint8_t x_cor = *vx % 64;
+      uint8_t y_cor = *vy % 32;
+
+      *vf = 0;
+
+      for (uint8_t i=0; i<inst_n && y_cor<32; i++, y_cor++)
+      {
+        // Sprite bits shifted into place, bits past the right edge fall off (clipping)
+        const uint64_t sprite_row = ((uint64_t)ram[(*reg_I + i) & 0x0FFF] << 56) >> x_cor;
+        uint64_t* display_row = &batch->display[lane][y_cor];
+
+        if (*display_row & sprite_row)
+          *vf = 1;
+
+        *display_row ^= sprite_row;
+      }
+      break;
+    }
+
+    case 0x0E:
+    {
+      const bool key_pressed = (*vx < 16) && ((batch->keypad[lane] >> *vx) & 0x01);
+
+      if (inst_nn == 0x9E)          // EX9E: Skip Next Instruction if Key in VX is Pressed
+        *pc += key_pressed ? 2 : 0;
+      else if (inst_nn == 0xA1)     // EXA1: Skip Next Instruction if Key in VX is not Pressed
+        *pc += key_pressed ? 0 : 2;
+      break;
+    }
+
+    case 0x0F:
+    {
+      if (inst_nn == 0x0A)        // FX0A: Await until key press and store in VX
+      {
+        const uint16_t keys = batch->keypad[lane];
+        if (keys)
+          *vx = __builtin_ctz(keys);
+        else
+          *pc -= 2;
+      }
+
+      else if (inst_nn == 0x1E)  *reg_I += *vx;              // FX1E: I += VX
+      else if (inst_nn == 0x07)  *vx = batch->delay_timer[lane];
+      else if (inst_nn == 0x15)  batch->delay_timer[lane] = *vx;
+      else if (inst_nn == 0x18)  batch->sound_timer[lane] = *vx;
+      else if (inst_nn == 0x29)  *reg_I = *vx * 5;            // FX29: I = font sprite for VX
+
+      else if (inst_nn == 0x33)  // FX33: BCD of VX at I
+      {
+        uint8_t* ram = batch_lane_ram_for_write(batch, lane);
+        if (ram != NULL)
+        {
+          ram[(*reg_I + 0) & 0x0FFF] = *vx / 100;
+          ram[(*reg_I + 1) & 0x0FFF] = (*vx / 10) % 10;
+          ram[(*reg_I + 2) & 0x0FFF] = *vx % 10;
+        }
+      }
+
+      else if (inst_nn == 0x55)  // FX55: Dump V0..VX at I
+      {
+        uint8_t* ram = batch_lane_ram_for_write(batch, lane);
+        for (uint8_t i=0; ram != NULL && i<=inst_x; i++)
+          ram[(*reg_I + i) & 0x0FFF] = batch->V[i][lane];
+
+        if (batch->quirks & QUIRK_MEMORY_INCREMENT)
+          *reg_I += inst_x + 1;
+      }
+
+      else if (inst_nn == 0x65)  // FX65: Load V0..VX from I
+      {
+        const uint8_t* ram = batch_lane_ram(batch, lane);
+        for (uint8_t i=0; i<=inst_x; i++)
+          batch->V[i][lane] = ram[(*reg_I + i) & 0x0FFF];
+
+        if (batch->quirks & QUIRK_MEMORY_INCREMENT)
+          *reg_I += inst_x + 1;
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+
+// 6XNN, 7XNN and 8XYN on every lane selected in exec_mask, LANE_VEC_WIDTH lanes at a time
+static void batch_execute_alu_masked(chip8_batch_t* batch, uint16_t inst_opcode)
+{
+  const uint8_t inst_nn  = inst_opcode & 0x00FF;
+  const uint8_t inst_n   = inst_opcode & 0x000F;
+  const uint8_t inst_x   = (inst_opcode & 0x0F00) >> 8;
+  const uint8_t inst_y   = (inst_opcode & 0x00F0) >> 4;
+  const uint8_t inst_op  = (inst_opcode & 0xF000) >> 12;
+
+  uint8_t* vx_lanes = batch->V[inst_x];
+  uint8_t* vy_lanes = batch->V[inst_y];
+  uint8_t* vf_lanes = batch->V[0x0F];
+
+  const lane_vec_t one = vec_set1(0x01);
+  const lane_vec_t nn = vec_set1(inst_nn);
+  const bool writes_vf = (inst_op == 0x08) && (inst_n >= 0x04);
+  const bool shift_uses_vy = (batch->quirks & QUIRK_SHIFT_USES_VY) && (inst_op == 0x08) && (inst_n == 0x06 || inst_n == 0x0E);
+  const bool resets_vf = (batch->quirks & QUIRK_VF_RESET) && (inst_op == 0x08) && (inst_n >= 0x01 && inst_n <= 0x03);
+
+  for (uint32_t l=0; l<batch->padded_lanes; l+=LANE_VEC_WIDTH)
+  {
+    const lane_vec_t mask = vec_load(&batch->exec_mask[l]);
+    const lane_vec_t vx = vec_load(&vx_lanes[l]);
+    const lane_vec_t vy = vec_load(&vy_lanes[l]);
+
+    // Shift quirk shifts VY into VX
+    const lane_vec_t source = shift_uses_vy ? vy : vx;
+
+    lane_vec_t result = vx;
+
+    if (inst_op == 0x06)       result = nn;
+    else if (inst_op == 0x07)  result = vec_add(vx, nn);
+    else if (inst_n == 0x00)   result = vy;
+    else if (inst_n == 0x01)   result = vec_or(vx, vy);
+    else if (inst_n == 0x02)   result = vec_and(vx, vy);
+    else if (inst_n == 0x03)   result = vec_xor(vx, vy);
+    else if (inst_n == 0x04)   result = vec_add(vx, vy);
+    else if (inst_n == 0x05)   result = vec_sub(vx, vy);
+    else if (inst_n == 0x06)   result = vec_srl1(source);
+    else if (inst_n == 0x07)   result = vec_sub(vy, vx);
+    else if (inst_n == 0x0E)   result = vec_add(source, source);
+
+    vec_store(&vx_lanes[l], vec_blend(vx, result, mask));
+
+    // Flags come from the original operands and VF is written last (reloaded after VX in case X is F), so the flag wins
+    if (writes_vf)
+    {
+      lane_vec_t flag = vec_set1(0x00);
+
+      if (inst_n == 0x04)       flag = vec_blend(one, flag, vec_cmpeq(vec_adds(vx, vy), vec_add(vx, vy)));   // carry
+      else if (inst_n == 0x05)  flag = vec_and(vec_cmpeq(vec_max(vx, vy), vx), one);                         // VX >= VY
+      else if (inst_n == 0x06)  flag = vec_and(source, one);                                                 // LSb
+      else if (inst_n == 0x07)  flag = vec_and(vec_cmpeq(vec_max(vy, vx), vy), one);                         // VY >= VX
+      else if (inst_n == 0x0E)  flag = vec_and(vec_cmpeq(vec_max(source, vec_set1(0x80)), source), one);    // MSb
+
+      vec_store(&vf_lanes[l], vec_blend(vec_load(&vf_lanes[l]), flag, mask));
+    }
+
+    // VF is cleared after the logic op, so it wins when X is F
+    if (resets_vf)
+      vec_store(&vf_lanes[l], vec_blend(vec_load(&vf_lanes[l]), vec_set1(0x00), mask));
+  }
+}
+
+
+// Emulate one instruction on every lane
+void emulate_batch_instructions(chip8_batch_t* batch)
+{
+  // Bucket lanes by PC so lanes that have not diverged share one decode
+  uint32_t num_groups = 0;
+  for (uint32_t l=0; l<batch->num_lanes; l++)
+  {
+    const uint16_t pc = batch->pc[l] & 0x0FFF;
+
+    if (batch->group_head[pc] < 0)
+      batch->group_pcs[num_groups++] = pc;
+
+    batch->group_next[l] = batch->group_head[pc];
+    batch->group_head[pc] = l;
+  }
+
+  for (uint32_t g=0; g<num_groups; g++)
+  {
+    const uint16_t pc = batch->group_pcs[g];
+    const uint16_t group_opcode = (batch->shared_ram[pc] << 8) | batch->shared_ram[(pc + 1) & 0x0FFF];
+    const uint8_t inst_op = group_opcode >> 12;
+
+    int32_t lane = batch->group_head[pc];
+    batch->group_head[pc] = -1;
+
+    // Count the group to decide between the masked SIMD kernels and lane by lane execution
+    uint32_t group_size = 0;
+    for (int32_t l=lane; l>=0 && group_size*BATCH_SIMD_GROUP_DIVISOR < batch->padded_lanes; l=batch->group_next[l])
+      group_size++;
+
+    const bool use_simd = (inst_op >= 0x06 && inst_op <= 0x08) && (group_size*BATCH_SIMD_GROUP_DIVISOR >= batch->padded_lanes);
+
+    if (!use_simd)
+    {
+      for (; lane>=0; lane=batch->group_next[lane])
+      {
+        const uint16_t opcode = (batch->ram[lane] != NULL) ? batch_lane_opcode(batch, lane, pc) : group_opcode;
+        batch->pc[lane] = pc;
+        batch_execute_lane(batch, lane, opcode);
+      }
+      continue;
+    }
+
+    memset(batch->exec_mask, 0x00, batch->padded_lanes);
+
+    for (; lane>=0; lane=batch->group_next[lane])
+    {
+      // Lanes that rewrote this instruction in their private RAM go their own way
+      if (batch->ram[lane] != NULL && batch_lane_opcode(batch, lane, pc) != group_opcode)
+      {
+        batch->pc[lane] = pc;
+        batch_execute_lane(batch, lane, batch_lane_opcode(batch, lane, pc));
+        continue;
+      }
+
+      batch->exec_mask[lane] = 0xFF;
+      batch->pc[lane] = pc + 2;
+    }
+
+    batch_execute_alu_masked(batch, group_opcode);
+  }
+}
+
+
+// Copy one lane into a single instance chip8_t, so it hashes like a single run of the same ROM and seed
+static void batch_lane_to_chip8(chip8_batch_t* batch, uint32_t lane, chip8_t* c8)
+{
+  memset(c8, 0, sizeof(*c8));
+  memcpy(c8->emu_ram, batch_lane_ram(batch, lane), sizeof(c8->emu_ram));
+
+  for (uint32_t y=0; y<CHIP8_DISPLAY_HEIGHT; y++)
+  {
+    for (uint32_t x=0; x<CHIP8_DISPLAY_WIDTH; x++)
+      c8->emu_display[y * CHIP8_DISPLAY_WIDTH + x] = (batch->display[lane][y] >> (63 - x)) & 0x01;
+  }
+
+  for (uint8_t i=0; i<16; i++)
+  {
+    c8->emu_V[i] = batch->V[i][lane];
+    c8->emu_keypad[i] = (batch->keypad[lane] >> i) & 0x01;
+  }
+
+  memcpy(c8->emu_subrStack, batch->stack[lane], sizeof(c8->emu_subrStack));
+  c8->emu_subrStack_ptr = &c8->emu_subrStack[batch->sp[lane]];
+  c8->emu_I = batch->I[lane];
+  c8->emu_pc = batch->pc[lane];
+  c8->emu_delayTimer = batch->delay_timer[lane];
+  c8->emu_soundTimer = batch->sound_timer[lane];
+  c8->emu_rng_state = batch->rng_state[lane];
+}
+
+
+// Set the keys held down on one lane (bit N = key N)
+void set_batch_lane_keys(chip8_batch_t* batch, uint32_t lane, uint16_t keys)
+{
+  if (lane < batch->num_lanes)
+    batch->keypad[lane] = keys;
+}
+
+
+// Update the timers of every lane
+void update_batch_timers(chip8_batch_t* batch)
+{
+  const lane_vec_t one = vec_set1(0x01);
+
+  for (uint32_t l=0; l<batch->padded_lanes; l+=LANE_VEC_WIDTH)
+  {
+    vec_store(&batch->delay_timer[l], vec_subs(vec_load(&batch->delay_timer[l]), one));
+    vec_store(&batch->sound_timer[l], vec_subs(vec_load(&batch->sound_timer[l]), one));
+  }
+}
+
+
+// Free everything allocated by init_chip8_batch
+void free_chip8_batch(chip8_batch_t* batch)
+{
+  if (batch->ram != NULL)
+  {
+    for (uint32_t l=0; l<batch->padded_lanes; l++)
+      free(batch->ram[l]);
+  }
+
+  for (uint8_t i=0; i<16; i++)
+    free(batch->V[i]);
+
+  free(batch->I);
+  free(batch->pc);
+  free(batch->sp);
+  free(batch->delay_timer);
+  free(batch->sound_timer);
+  free(batch->keypad);
+  free(batch->rng_state);
+  free(batch->stack);
+  free(batch->display);
+  free(batch->ram);
+  free(batch->exec_mask);
+  free(batch->group_next);
+
+  memset(batch, 0, sizeof(*batch));
+}
+
+
+// Run the ROM on cfg->batch_lanes lanes for cfg->batch_frames frames without a window, report throughput and each lane's state hash
+bool run_chip8_batch(user_config_params_t* cfg, rom_file_t* rom, uint32_t seed)
+{
+  chip8_batch_t* batch = malloc(sizeof(chip8_batch_t));
+  if (batch == NULL || !init_chip8_batch(batch, cfg->batch_lanes, rom, seed))
+  {
+    free(batch);
+    return false;
+  }
+
+  batch->quirks = cfg->quirks;
+
+  // Each lane can be given its own key presses
+  uint32_t num_events = 0;
+  input_event_t* events = NULL;
+  if (cfg->batch_input_path != NULL)
+  {
+    events = load_input_script(cfg->batch_input_path, cfg->batch_lanes, &num_events);
+    if (events == NULL)
+    {
+      free_chip8_batch(batch);
+      free(batch);
+      return false;
+    }
+  }
+
+  const uint32_t instructions_per_frame = cfg->instructions_per_second / 60;
+  const uint64_t time_before = SDL_GetPerformanceCounter();
+  uint32_t next_event = 0;
+
+  for (uint32_t frame=0; frame<cfg->batch_frames; frame++)
+  {
+    for (; next_event < num_events && events[next_event].frame <= frame; next_event++)
+    {
+      const input_event_t* event = &events[next_event];
+
+      if (event->lane < 0)
+      {
+        for (uint32_t l=0; l<batch->num_lanes; l++)
+          set_batch_lane_keys(batch, l, event->keys);
+      }
+      else
+        set_batch_lane_keys(batch, event->lane, event->keys);
+    }
+
+    for (uint32_t i=0; i<instructions_per_frame; i++)
+      emulate_batch_instructions(batch);
+
+    update_batch_timers(batch);
+  }
+
+  const double seconds = (double)(SDL_GetPerformanceCounter() - time_before) / SDL_GetPerformanceFrequency();
+  const double instructions = (double)cfg->batch_frames * instructions_per_frame * cfg->batch_lanes;
+
+  printf("Batch: %u lanes x %u frames, %.0f instructions in %.3fs (%.1f M instructions/s, %u lanes with private RAM, %u-lane SIMD)\n",
+         (unsigned int)cfg->batch_lanes, (unsigned int)cfg->batch_frames, instructions, seconds,
+         seconds > 0 ? instructions / seconds / 1e6 : 0.0, (unsigned int)batch->private_lanes, (unsigned int)LANE_VEC_WIDTH);
+
+  // Each lane's final state hash, equal to what a single instance run with --seed SEED --hash prints
+  chip8_t lane_c8;
+  for (uint32_t l=0; l<batch->num_lanes; l++)
+  {
+    batch_lane_to_chip8(batch, l, &lane_c8);
+    printf("Lane %u seed %u state hash after %u frames: %016llx\n",
+           (unsigned int)l, (unsigned int)(seed + l), (unsigned int)cfg->batch_frames, (unsigned long long)hash_chip8_state(&lane_c8));
+  }
+
+  free(events);
+  free_chip8_batch(batch);
+  free(batch);
+  return true;
+}
@@ -0,0 +1,728 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "chip8Emu.h"
+
+
+
+// Read a 32 bit big endian value
+static uint32_t png_get_u32(const uint8_t* in)
+{
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+
+// Write a 32 bit big endian value (PNG chunk lengths, sizes and CRCs)
+static void png_put_u32(uint8_t* out, uint32_t value)
+{
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+
+// CRC32 table, built once on first use (the writer thread and the main thread both write PNGs)
+static uint32_t png_crc_table[256];
+static pthread_once_t png_crc_table_once = PTHREAD_ONCE_INIT;
+
+static void png_build_crc_table(void)
+{
+  for (uint32_t n=0; n<256; n++)
+  {
+    uint32_t c = n;
+    for (uint8_t k=0; k<8; k++)
+      c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+    png_crc_table[n] = c;
+  }
+}
+
+
+// Continue a PNG chunk CRC32 (start from 0xFFFFFFFF, xor the final value with 0xFFFFFFFF)
+static uint32_t png_crc32_update(uint32_t crc, const uint8_t* data, size_t length)
+{
+  for (size_t i=0; i<length; i++)
+    crc = png_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+  return crc;
+}
+
+
+// Continue the zlib Adler-32, taking the modulo once per PNG_ADLER_NMAX bytes
+// (5552 is the longest run after which b cannot overflow 32 bits, starting from a, b < 65521)
+#define PNG_ADLER_BASE 65521
+#define PNG_ADLER_NMAX 5552
+
+static void png_adler32_update(uint32_t* adler_a, uint32_t* adler_b, const uint8_t* data, size_t length)
+{
+  uint32_t a = *adler_a, b = *adler_b;
+
+  while (length > 0)
+  {
+    size_t run = (length < PNG_ADLER_NMAX) ? length : PNG_ADLER_NMAX;
+    length -= run;
+
+    for (; run>0; run--)
+    {
+      a += *data++;
+      b += a;
+    }
+
+    a %= PNG_ADLER_BASE;
+    b %= PNG_ADLER_BASE;
+  }
+
+  *adler_a = a;
+  *adler_b = b;
+}
+
+
+// Write one PNG chunk, data must have 4 free bytes before it for the chunk type
+static bool png_write_chunk(FILE* file, const char type[4], uint8_t* type_and_data, uint32_t data_length)
+{
+  uint8_t length_bytes[4], crc_bytes[4];
+
+  memcpy(type_and_data, type, 4);
+  png_put_u32(length_bytes, data_length);
+  png_put_u32(crc_bytes, png_crc32_update(0xFFFFFFFFu, type_and_data, data_length + 4) ^ 0xFFFFFFFFu);
+
+  return fwrite(length_bytes, 4, 1, file) == 1 &&
+         fwrite(type_and_data, data_length + 4, 1, file) == 1 &&
+         fwrite(crc_bytes, 4, 1, file) == 1;
+}
+
+
+// The IDAT chunk is streamed to the file piece by piece, keeping its CRC and the zlib Adler-32 of the image bytes
+typedef struct
+{
+  FILE* file;
+  uint32_t crc;
+  uint32_t adler_a;
+  uint32_t adler_b;
+  bool ok;
+} png_stream_t;
+
+static void png_stream_write(png_stream_t* stream, const uint8_t* data, size_t length, bool image_data)
+{
+  stream->crc = png_crc32_update(stream->crc, data, length);
+  if (image_data)
+    png_adler32_update(&stream->adler_a, &stream->adler_b, data, length);
+
+  stream->ok &= (length == 0 || fwrite(data, length, 1, stream->file) == 1);
+}
+
+
+// Write an RGBA image as an (uncompressed) PNG file
+bool write_png_rgba(const char* path, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+  pthread_once(&png_crc_table_once, png_build_crc_table);
+
+  // Image data is a zlib stream of stored (uncompressed) deflate blocks, each row starts with filter byte 0
+  // Every row gets its own block(s), so rows go straight from rgba to the file without being copied
+  const size_t row_bytes = (size_t)width * 4;
+  const size_t blocks_per_row = (1 + row_bytes + 0xFFFF - 1) / 0xFFFF;
+  const size_t zlib_length = 2 + (size_t)height * (blocks_per_row * 5 + 1 + row_bytes) + 4;
+  if (zlib_length > 0x7FFFFFFF)
+    return false;
+
+  uint8_t ihdr[4 + 13] = {0};
+  png_put_u32(&ihdr[4], width);
+  png_put_u32(&ihdr[8], height);
+  ihdr[12] = 8;     // Bit depth
+  ihdr[13] = 6;     // Color type RGBA
+
+  uint8_t iend[4];
+  static const uint8_t png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  static const uint8_t zlib_header[2] = {0x78, 0x01};
+  static const uint8_t filter_none = 0;
+
+  FILE* file = fopen(path, "wb");
+  if (file == NULL)
+    return false;
+
+  bool written = fwrite(png_signature, sizeof(png_signature), 1, file) == 1 && png_write_chunk(file, "IHDR", ihdr, 13);
+
+  uint8_t idat_header[8];
+  png_put_u32(&idat_header[0], (uint32_t)zlib_length);
+  memcpy(&idat_header[4], "IDAT", 4);
+  written = written && fwrite(idat_header, 4, 1, file) == 1;
+
+  png_stream_t stream = {.file = file, .crc = 0xFFFFFFFFu, .adler_a = 1, .adler_b = 0, .ok = written};
+  png_stream_write(&stream, &idat_header[4], 4, false);
+  png_stream_write(&stream, zlib_header, sizeof(zlib_header), false);
+
+  for (uint32_t y=0; stream.ok && y<height; y++)
+  {
+    const uint8_t* row = &rgba[(size_t)y * row_bytes];
+    size_t row_left = 1 + row_bytes;
+
+    while (row_left > 0)
+    {
+      const uint16_t block_length = (row_left > 0xFFFF) ? 0xFFFF : (uint16_t)row_left;
+      const bool final_block = (y == height - 1) && (row_left == block_length);
+      const uint8_t block_header[5] = {final_block ? 0x01 : 0x00, block_length & 0xFF, block_length >> 8,
+                                       ~block_length & 0xFF, (uint16_t)~block_length >> 8};
+      png_stream_write(&stream, block_header, sizeof(block_header), false);
+
+      // The filter byte leads the first block of the row
+      size_t pixel_bytes = block_length;
+      if (row_left == 1 + row_bytes)
+      {
+        png_stream_write(&stream, &filter_none, 1, true);
+        pixel_bytes--;
+      }
+
+      png_stream_write(&stream, row, pixel_bytes, true);
+      row += pixel_bytes;
+      row_left -= block_length;
+    }
+  }
+
+  uint8_t adler_bytes[4], crc_bytes[4];
+  png_put_u32(adler_bytes, (stream.adler_b << 16) | stream.adler_a);
+  png_stream_write(&stream, adler_bytes, 4, false);
+  png_put_u32(crc_bytes, stream.crc ^ 0xFFFFFFFFu);
+
+  written = stream.ok && fwrite(crc_bytes, 4, 1, file) == 1 && png_write_chunk(file, "IEND", iend, 0);
+  written &= (fclose(file) == 0);
+  return written;
+}
+
+
+// Read an RGBA PNG as written by write_png_rgba (stored deflate blocks, filter 0), NULL for anything else
+static uint8_t* read_png_rgba(const char* path, uint32_t* width, uint32_t* height)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+
+  fseek(file, 0, SEEK_END);
+  const long file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  uint8_t* png = (file_size > 0) ? malloc(file_size) : NULL;
+  const bool read_ok = (png != NULL) && fread(png, 1, file_size, file) == (size_t)file_size;
+  fclose(file);
+
+  uint8_t* rgba = NULL;
+  uint8_t* zlib = NULL;
+  size_t zlib_length = 0;
+  *width = *height = 0;
+
+  // Signature, then chunks: IHDR must be 8 bit RGBA without interlacing, IDAT chunks are joined
+  bool ok = read_ok && file_size > 8 && memcmp(png, "\x89PNG\r\n\x1A\n", 8) == 0;
+  for (long offset=8; ok && offset + 12 <= file_size; )
+  {
+    const uint32_t length = png_get_u32(&png[offset]);
+    const uint8_t* type = &png[offset + 4];
+    const uint8_t* data = &png[offset + 8];
+    if ((long)length > file_size - offset - 12)
+    {
+      ok = false;
+      break;
+    }
+
+    if (memcmp(type, "IHDR", 4) == 0)
+    {
+      // Fields are only read once the chunk is known to hold all 13 bytes of them
+      ok = (length == 13);
+      if (ok)
+      {
+        *width = png_get_u32(&data[0]);
+        *height = png_get_u32(&data[4]);
+        ok = (data[8] == 8 && data[9] == 6 && data[12] == 0 && *width > 0 && *height > 0 && *width <= 0x4000 && *height <= 0x4000);
+      }
+    }
+    else if (memcmp(type, "IDAT", 4) == 0)
+    {
+      uint8_t* grown = realloc(zlib, zlib_length + length);
+      ok = (grown != NULL);
+      if (ok)
+      {
+        zlib = grown;
+        memcpy(&zlib[zlib_length], data, length);
+        zlib_length += length;
+      }
+    }
+    else if (memcmp(type, "IEND", 4) == 0)
+      break;
+
+    offset += 12 + length;
+  }
+
+  // zlib header, then stored blocks holding rows of filter byte 0 + RGBA
+  const size_t row_length = 1 + (size_t)*width * 4;
+  const size_t raw_length = row_length * *height;
+  uint8_t* raw = (ok && *width > 0) ? malloc(raw_length) : NULL;
+  size_t raw_offset = 0;
+  size_t in = 2;
+  bool final_block = false;
+
+  ok = ok && raw != NULL && zlib_length > 2;
+  while (ok && !final_block && in + 5 <= zlib_length)
+  {
+    const uint8_t header = zlib[in];
+    const uint16_t block_length = zlib[in + 1] | (zlib[in + 2] << 8);
+    final_block = header & 0x01;
+
+    ok = ((header >> 1) & 0x03) == 0 && in + 5 + block_length <= zlib_length && raw_offset + block_length <= raw_length;
+    if (ok)
+    {
+      memcpy(&raw[raw_offset], &zlib[in + 5], block_length);
+      raw_offset += block_length;
+      in += 5 + block_length;
+    }
+  }
+
+  ok = ok && final_block && raw_offset == raw_length;
+  if (ok)
+    rgba = malloc((size_t)*width * *height * 4);
+
+  for (uint32_t y=0; rgba != NULL && y<*height; y++)
+  {
+    if (raw[y * row_length] != 0)
+    {
+      free(rgba);
+      rgba = NULL;
+      break;
+    }
+    memcpy(&rgba[(size_t)y * *width * 4], &raw[y * row_length + 1], (size_t)*width * 4);
+  }
+
+  free(raw);
+  free(zlib);
+  free(png);
+  return rgba;
+}
+
+
+// Expand the display into one byte per output pixel (a Y4M plane)
+static void capture_expand_plane(capture_params_t* capture_params, const bool* display, uint8_t* plane, uint8_t on_value, uint8_t off_value)
+{
+  const uint32_t scale = capture_params->scale_factor;
+  const uint32_t out_width = capture_params->display_width * scale;
+
+  for (uint32_t y=0; y<capture_params->display_height; y++)
+  {
+    uint8_t* out_row = &plane[(size_t)y * scale * out_width];
+
+    for (uint32_t x=0; x<capture_params->display_width; x++)
+      memset(&out_row[x * scale], display[y * capture_params->display_width + x] ? on_value : off_value, scale);
+
+    // Remaining rows of this pixel row are copies of the first
+    for (uint32_t i=1; i<scale; i++)
+      memcpy(&out_row[(size_t)i * out_width], out_row, out_width);
+  }
+}
+
+
+// Expand the display into 4 bytes (R, G, B, A) per output pixel
+static void capture_expand_rgba(const bool* display, uint32_t width, uint32_t height, uint32_t scale, uint32_t fg_color, uint32_t bg_color, uint8_t* rgba)
+{
+  const size_t out_row_bytes = (size_t)width * scale * 4;
+
+  // Colors are stored as 0xRRGGBBAA
+  const uint8_t fg[4] = {fg_color >> 24, fg_color >> 16, fg_color >> 8, fg_color};
+  const uint8_t bg[4] = {bg_color >> 24, bg_color >> 16, bg_color >> 8, bg_color};
+
+  for (uint32_t y=0; y<height; y++)
+  {
+    uint8_t* out_row = &rgba[(size_t)y * scale * out_row_bytes];
+    uint8_t* out_pixel = out_row;
+
+    for (uint32_t x=0; x<width; x++)
+    {
+      const uint8_t* color = display[y * width + x] ? fg : bg;
+      for (uint32_t i=0; i<scale; i++, out_pixel+=4)
+        memcpy(out_pixel, color, 4);
+    }
+
+    for (uint32_t i=1; i<scale; i++)
+      memcpy(&out_row[i * out_row_bytes], out_row, out_row_bytes);
+  }
+}
+
+
+// BT.601 limited range Y, Cb, Cr of a 0xRRGGBBAA color
+static void capture_color_to_yuv(uint32_t color, uint8_t yuv[3])
+{
+  const double r = (color >> 24) & 0xFF;
+  const double g = (color >> 16) & 0xFF;
+  const double b = (color >>  8) & 0xFF;
+
+  yuv[0] = (uint8_t)(16.0  + ( 65.481 * r + 128.553 * g +  24.966 * b) / 255.0 + 0.5);
+  yuv[1] = (uint8_t)(128.0 + (-37.797 * r -  74.203 * g + 112.000 * b) / 255.0 + 0.5);
+  yuv[2] = (uint8_t)(128.0 + (112.000 * r -  93.786 * g -  18.214 * b) / 255.0 + 0.5);
+}
+
+
+// PNG paths may hold one %u or %d conversion (optionally zero padded, e.g. %06u) for the frame number, plus any %% literals
+// Anything else would hand the user's path to printf as an unchecked format string
+static bool capture_check_pattern(const char* path, bool* is_pattern)
+{
+  uint32_t conversions = 0;
+
+  for (const char* p=path; *p != '\0'; p++)
+  {
+    if (*p != '%')
+      continue;
+
+    p++;
+    if (*p == '%')
+      continue;
+
+    while (*p >= '0' && *p <= '9')
+      p++;
+
+    if (*p != 'u' && *p != 'd')
+      return false;
+
+    conversions++;
+  }
+
+  *is_pattern = (conversions == 1);
+  return conversions <= 1;
+}
+
+
+// Expand one queued frame and write it out (runs on the writer thread)
+static bool capture_write_slot(capture_params_t* capture_params, capture_slot_t* slot)
+{
+  const size_t out_pixels = (size_t)capture_params->display_width * capture_params->scale_factor *
+                            capture_params->display_height * capture_params->scale_factor;
+
+  switch (capture_params->format)
+  {
+    case CAPTURE_Y4M:
+    {
+      uint8_t fg_yuv[3], bg_yuv[3];
+      capture_color_to_yuv(capture_params->fg_color, fg_yuv);
+      capture_color_to_yuv(capture_params->bg_color, bg_yuv);
+
+      for (uint8_t plane=0; plane<3; plane++)
+        capture_expand_plane(capture_params, slot->display, &capture_params->frame_buffer[plane * out_pixels], fg_yuv[plane], bg_yuv[plane]);
+
+      return fputs("FRAME\n", capture_params->output_file) >= 0 &&
+             fwrite(capture_params->frame_buffer, out_pixels * 3, 1, capture_params->output_file) == 1;
+    }
+
+    case CAPTURE_RGBA:
+    {
+      capture_expand_rgba(slot->display, capture_params->display_width, capture_params->display_height, capture_params->scale_factor,
+                          capture_params->fg_color, capture_params->bg_color, capture_params->frame_buffer);
+      return fwrite(capture_params->frame_buffer, out_pixels * 4, 1, capture_params->output_file) == 1;
+    }
+
+    case CAPTURE_PNG:
+    {
+      // Path is a printf pattern for the frame number (checked by capture_check_pattern), or a prefix if it has no pattern
+      char png_path[1024];
+      if (capture_params->path_is_pattern)
+        snprintf(png_path, sizeof(png_path), capture_params->path, (unsigned int)slot->frame_number);
+      else
+        snprintf(png_path, sizeof(png_path), "%s%06u.png", capture_params->path, (unsigned int)slot->frame_number);
+
+      capture_expand_rgba(slot->display, capture_params->display_width, capture_params->display_height, capture_params->scale_factor,
+                          capture_params->fg_color, capture_params->bg_color, capture_params->frame_buffer);
+      return write_png_rgba(png_path, capture_params->frame_buffer,
+                            capture_params->display_width * capture_params->scale_factor,
+                            capture_params->display_height * capture_params->scale_factor);
+    }
+
+    default:
+      return false;
+  }
+}
+
+
+// Writer thread: wait for queued frames and write them until told to stop
+static void* capture_writer_thread(void* arg)
+{
+  capture_params_t* capture_params = arg;
+  bool write_error = false;
+
+  while (true)
+  {
+    // One post per queued frame, plus a final one from close_capture
+    sem_wait(&capture_params->frames_ready);
+
+    const uint32_t tail = atomic_load_explicit(&capture_params->ring_tail, memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&capture_params->ring_head, memory_order_acquire);
+
+    if (tail == head)
+    {
+      if (atomic_load_explicit(&capture_params->stop_writer, memory_order_acquire))
+        break;
+
+      continue;
+    }
+
+    if (!write_error && !capture_write_slot(capture_params, &capture_params->slots[tail % CAPTURE_RING_SLOTS]))
+    {
+      SDL_Log("Error writing capture frame %u ... further frames are discarded", (unsigned int)capture_params->slots[tail % CAPTURE_RING_SLOTS].frame_number);
+      write_error = true;
+    }
+    else if (!write_error)
+    {
+      capture_params->frames_written++;
+    }
+
+    // Hand the slot back to the emulator
+    atomic_store_explicit(&capture_params->ring_tail, tail + 1, memory_order_release);
+    sem_post(&capture_params->slots_free);
+  }
+
+  return NULL;
+}
+
+
+// Open the capture output and start the writer thread (return true if initialized)
+bool init_capture(capture_params_t* capture_params, user_config_params_t* cfg)
+{
+  capture_params->format = cfg->capture_format;
+  capture_params->path = cfg->capture_path;
+  capture_params->dedup = cfg->capture_dedup;
+  capture_params->display_width = cfg->window_width;
+  capture_params->display_height = cfg->window_height;
+  capture_params->scale_factor = cfg->scale_factor;
+  capture_params->fg_color = cfg->fg_color;
+  capture_params->bg_color = cfg->bg_color;
+
+  // Skipping repeated frames would break the fixed 60 fps timing of a video stream
+  if (capture_params->dedup && capture_params->format != CAPTURE_PNG)
+  {
+    SDL_Log("--capture-dedup only works with PNG sequences (--capture-format png)");
+    return false;
+  }
+
+  if (capture_params->format == CAPTURE_PNG && !capture_check_pattern(cfg->capture_path, &capture_params->path_is_pattern))
+  {
+    SDL_Log("Capture path %s may only hold one %%u or %%d for the frame number (use %%%% for a literal %%)", cfg->capture_path);
+    return false;
+  }
+
+  // Largest frame is RGBA (Y4M needs 3 bytes per pixel)
+  const size_t out_width = (size_t)cfg->window_width * cfg->scale_factor;
+  const size_t out_height = (size_t)cfg->window_height * cfg->scale_factor;
+  capture_params->frame_buffer = malloc(out_width * out_height * 4);
+  capture_params->slots = malloc(CAPTURE_RING_SLOTS * sizeof(capture_slot_t));
+  if (capture_params->frame_buffer == NULL || capture_params->slots == NULL)
+  {
+    SDL_Log("Could not allocate capture buffers ... exiting!");
+    free(capture_params->frame_buffer);
+    free(capture_params->slots);
+    capture_params->frame_buffer = NULL;
+    return false;
+  }
+
+  if (capture_params->format != CAPTURE_PNG)
+  {
+    capture_params->output_file = fopen(cfg->capture_path, "wb");
+    if (capture_params->output_file == NULL)
+    {
+      SDL_Log("Could not open capture file %s ... exiting!", cfg->capture_path);
+      free(capture_params->frame_buffer);
+      free(capture_params->slots);
+      capture_params->frame_buffer = NULL;
+      return false;
+    }
+
+    if (capture_params->format == CAPTURE_Y4M)
+      fprintf(capture_params->output_file, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n", (unsigned int)out_width, (unsigned int)out_height);
+  }
+
+  atomic_store(&capture_params->ring_head, 0);
+  atomic_store(&capture_params->ring_tail, 0);
+  atomic_store(&capture_params->stop_writer, false);
+  sem_init(&capture_params->frames_ready, 0, 0);
+  sem_init(&capture_params->slots_free, 0, CAPTURE_RING_SLOTS);
+
+  if (pthread_create(&capture_params->writer_thread, NULL, capture_writer_thread, capture_params) != 0)
+  {
+    SDL_Log("Could not start capture writer thread ... exiting!");
+    if (capture_params->output_file != NULL)
+      fclose(capture_params->output_file);
+    free(capture_params->frame_buffer);
+    free(capture_params->slots);
+    capture_params->frame_buffer = NULL;
+    sem_destroy(&capture_params->frames_ready);
+    sem_destroy(&capture_params->slots_free);
+    return false;
+  }
+
+  return true;
+}
+
+
+// Queue the current frame for the writer thread (dropped if the ring is full, emulation never waits for the disk)
+void capture_frame(capture_params_t* capture_params, chip8_t* c8)
+{
+  capture_params->frame_number++;
+
+  if (capture_params->dedup && capture_params->has_last_display &&
+      memcmp(capture_params->last_display, c8->emu_display, sizeof(c8->emu_display)) == 0)
+  {
+    capture_params->frames_deduped++;
+    return;
+  }
+
+  // Writer is behind: drop this frame rather than stall the emulator, the count is reported on close
+  if (sem_trywait(&capture_params->slots_free) != 0)
+  {
+    if (capture_params->frames_dropped++ == 0)
+      SDL_Log("Capture writer is falling behind at frame %u ... dropping frames", (unsigned int)capture_params->frame_number);
+
+    return;
+  }
+
+  const uint32_t head = atomic_load_explicit(&capture_params->ring_head, memory_order_relaxed);
+
+  capture_slot_t* slot = &capture_params->slots[head % CAPTURE_RING_SLOTS];
+  memcpy(slot->display, c8->emu_display, sizeof(slot->display));
+  slot->frame_number = capture_params->frame_number;
+
+  atomic_store_explicit(&capture_params->ring_head, head + 1, memory_order_release);
+  sem_post(&capture_params->frames_ready);
+
+  if (capture_params->dedup)
+  {
+    memcpy(capture_params->last_display, c8->emu_display, sizeof(capture_params->last_display));
+    capture_params->has_last_display = true;
+  }
+}
+
+
+// Flush queued frames, stop the writer thread and close the output
+void close_capture(capture_params_t* capture_params)
+{
+  if (capture_params->frame_buffer == NULL)
+    return;
+
+  atomic_store_explicit(&capture_params->stop_writer, true, memory_order_release);
+  sem_post(&capture_params->frames_ready);
+  pthread_join(capture_params->writer_thread, NULL);
+  sem_destroy(&capture_params->frames_ready);
+  sem_destroy(&capture_params->slots_free);
+
+  if (capture_params->output_file != NULL)
+    fclose(capture_params->output_file);
+
+  SDL_Log("Capture: %u frames written, %u duplicates skipped, %u frames dropped (writer too slow)",
+          (unsigned int)capture_params->frames_written, (unsigned int)capture_params->frames_deduped, (unsigned int)capture_params->frames_dropped);
+
+  free(capture_params->frame_buffer);
+  free(capture_params->slots);
+  capture_params->frame_buffer = NULL;
+  capture_params->slots = NULL;
+  capture_params->output_file = NULL;
+}
+
+
+// Write the current display as a PNG using the configured scale and colors
+bool write_display_png(const char* path, user_config_params_t* cfg, chip8_t* c8)
+{
+  const uint32_t out_width = cfg->window_width * cfg->scale_factor;
+  const uint32_t out_height = cfg->window_height * cfg->scale_factor;
+
+  uint8_t* rgba = malloc((size_t)out_width * out_height * 4);
+  if (rgba == NULL)
+    return false;
+
+  capture_expand_rgba(c8->emu_display, cfg->window_width, cfg->window_height, cfg->scale_factor, cfg->fg_color, cfg->bg_color, rgba);
+  const bool written = write_png_rgba(path, rgba, out_width, out_height);
+
+  free(rgba);
+  return written;
+}
+
+
+// Write a PNG comparing the display with a reference PNG of the expected frame (any scale, same colors):
+// pixels lit in both are grey, missing ones red, extra ones green
+bool write_display_diff_png(const char* reference_path, const char* path, user_config_params_t* cfg, chip8_t* c8)
+{
+  uint32_t ref_width, ref_height;
+  uint8_t* reference = read_png_rgba(reference_path, &ref_width, &ref_height);
+  if (reference == NULL)
+  {
+    SDL_Log("Cannot read reference frame %s (only PNGs written by chip8Emu are supported)", reference_path);
+    return false;
+  }
+
+  const uint32_t display_width = cfg->window_width;
+  const uint32_t display_height = cfg->window_height;
+  if (ref_width % display_width != 0 || ref_height % display_height != 0)
+  {
+    SDL_Log("Reference frame %s is %ux%u, not a multiple of the %ux%u display", reference_path,
+            (unsigned int)ref_width, (unsigned int)ref_height, (unsigned int)display_width, (unsigned int)display_height);
+    free(reference);
+    return false;
+  }
+
+  // A reference pixel is lit when it is closer to the foreground than to the background color
+  const int32_t fg_brightness = ((cfg->fg_color >> 24) & 0xFF) + ((cfg->fg_color >> 16) & 0xFF) + ((cfg->fg_color >> 8) & 0xFF);
+  const int32_t bg_brightness = ((cfg->bg_color >> 24) & 0xFF) + ((cfg->bg_color >> 16) & 0xFF) + ((cfg->bg_color >> 8) & 0xFF);
+  const uint32_t ref_scale_x = ref_width / display_width;
+  const uint32_t ref_scale_y = ref_height / display_height;
+
+  bool* expected = malloc((size_t)display_width * display_height * sizeof(bool));
+  bool* diff_display = malloc((size_t)display_width * display_height * sizeof(bool));
+  const uint32_t scale = cfg->scale_factor;
+  uint8_t* rgba = malloc((size_t)display_width * scale * display_height * scale * 4);
+
+  bool written = false;
+  if (expected != NULL && diff_display != NULL && rgba != NULL)
+  {
+    uint32_t differing = 0;
+    for (uint32_t y=0; y<display_height; y++)
+    {
+      for (uint32_t x=0; x<display_width; x++)
+      {
+        const uint8_t* pixel = &reference[((size_t)y * ref_scale_y * ref_width + (size_t)x * ref_scale_x) * 4];
+        const int32_t brightness = pixel[0] + pixel[1] + pixel[2];
+        const uint32_t i = y * display_width + x;
+
+        expected[i] = (fg_brightness >= bg_brightness) ? (2 * brightness > fg_brightness + bg_brightness) : (2 * brightness < fg_brightness + bg_brightness);
+        differing += (expected[i] != c8->emu_display[i]);
+      }
+    }
+
+    // Three passes of the regular expander, one per class of pixel
+    const uint32_t colors[3] = {0x808080FFu, 0xFF0000FFu, 0x00FF00FFu};
+    memset(rgba, 0, (size_t)display_width * scale * display_height * scale * 4);
+
+    uint8_t* layer = malloc((size_t)display_width * scale * display_height * scale * 4);
+    for (uint8_t pass=0; layer != NULL && pass<3; pass++)
+    {
+      for (uint32_t i=0; i<display_width * display_height; i++)
+      {
+        const bool actual = c8->emu_display[i];
+        diff_display[i] = (pass == 0) ? (actual && expected[i]) : (pass == 1) ? (!actual && expected[i]) : (actual && !expected[i]);
+      }
+
+      capture_expand_rgba(diff_display, display_width, display_height, scale, colors[pass], 0x00000000u, layer);
+      for (size_t b=0; b<(size_t)display_width * scale * display_height * scale * 4; b++)
+        rgba[b] |= layer[b];
+    }
+
+    if (layer != NULL)
+    {
+      // Background pixels are opaque black
+      for (size_t p=3; p<(size_t)display_width * scale * display_height * scale * 4; p+=4)
+        rgba[p] = 0xFF;
+
+      written = write_png_rgba(path, rgba, display_width * scale, display_height * scale);
+      SDL_Log("%u of %u pixels differ from %s, diff written to %s", (unsigned int)differing,
+              (unsigned int)(display_width * display_height), reference_path, path);
+    }
+    free(layer);
+  }
+
+  free(rgba);
+  free(diff_display);
+  free(expected);
+  free(reference);
+  return written;
+}
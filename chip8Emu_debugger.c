@@ -0,0 +1,576 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "chip8Emu.h"
+
+
+
+// Keep the armed flag in sync, so the main loop drops back to the fast path as soon as nothing is set
+static void debug_update_armed(debugger_params_t* dbg)
+{
+  dbg->armed = (dbg->num_pc_breakpoints > 0) || (dbg->num_ram_watchpoints > 0) ||
+               (dbg->v_watch_mask != 0) || (dbg->v_read_watch_mask != 0) || (dbg->step_mode != STEP_NONE) || dbg->resuming;
+}
+
+
+static inline bool debug_has_breakpoint(debugger_params_t* dbg, uint16_t addr)
+{
+  return dbg->pc_breakpoints[(addr & 0x0FFF) / 8] & (1 << (addr % 8));
+}
+
+
+static inline uint16_t debug_opcode_at(chip8_t* c8, uint16_t addr)
+{
+  return (c8->emu_ram[addr & 0x0FFF] << 8) | c8->emu_ram[(addr + 1) & 0x0FFF];
+}
+
+
+// RAM range an instruction reads or writes (false if it does not touch RAM)
+static bool debug_ram_access(chip8_t* c8, uint16_t opcode, uint16_t* start, uint16_t* end, bool* is_write)
+{
+  const uint8_t inst_op = opcode >> 12;
+  const uint8_t inst_x = (opcode >> 8) & 0x0F;
+  const uint8_t inst_nn = opcode & 0xFF;
+  const uint8_t inst_n = opcode & 0x0F;
+
+  *start = c8->emu_I;
+
+  if (inst_op == 0x0D && inst_n > 0)     { *end = c8->emu_I + inst_n - 1;  *is_write = false;  return true; }   // DXYN reads the sprite
+  if (inst_op == 0x0F && inst_nn == 0x33) { *end = c8->emu_I + 2;           *is_write = true;   return true; }   // FX33 writes 3 digits
+  if (inst_op == 0x0F && inst_nn == 0x55) { *end = c8->emu_I + inst_x;      *is_write = true;   return true; }   // FX55 writes V0..VX
+  if (inst_op == 0x0F && inst_nn == 0x65) { *end = c8->emu_I + inst_x;      *is_write = false;  return true; }   // FX65 reads V0..VX
+
+  return false;
+}
+
+
+// V registers an instruction writes (bit N = VN)
+static uint16_t debug_written_v_mask(uint16_t opcode)
+{
+  const uint8_t inst_op = opcode >> 12;
+  const uint8_t inst_x = (opcode >> 8) & 0x0F;
+  const uint8_t inst_nn = opcode & 0xFF;
+  const uint8_t inst_n = opcode & 0x0F;
+
+  switch (inst_op)
+  {
+    case 0x06:
+    case 0x07:
+    case 0x0C:
+      return 1 << inst_x;
+
+    case 0x08:
+      if (inst_n <= 0x03)                                    return 1 << inst_x;
+      if ((inst_n >= 0x04 && inst_n <= 0x07) || inst_n == 0x0E)  return (1 << inst_x) | (1 << 0x0F);
+      return 0;
+
+    case 0x0D:
+      return 1 << 0x0F;
+
+    case 0x0F:
+      if (inst_nn == 0x07 || inst_nn == 0x0A)  return 1 << inst_x;
+      if (inst_nn == 0x65)                     return (2 << inst_x) - 1;
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+
+// V registers an instruction reads (bit N = VN)
+static uint16_t debug_read_v_mask(uint16_t opcode, uint32_t quirks)
+{
+  const uint8_t inst_op = opcode >> 12;
+  const uint8_t inst_x = (opcode >> 8) & 0x0F;
+  const uint8_t inst_y = (opcode >> 4) & 0x0F;
+  const uint8_t inst_nn = opcode & 0xFF;
+  const uint8_t inst_n = opcode & 0x0F;
+
+  switch (inst_op)
+  {
+    case 0x03:
+    case 0x04:
+    case 0x07:
+    case 0x0E:
+      return 1 << inst_x;
+
+    case 0x05:
+    case 0x09:
+    case 0x0D:
+      return (1 << inst_x) | (1 << inst_y);
+
+    case 0x08:
+      if (inst_n == 0x00)                        return 1 << inst_y;
+      if (inst_n <= 0x05 || inst_n == 0x07)      return (1 << inst_x) | (1 << inst_y);
+      if (inst_n == 0x06 || inst_n == 0x0E)      return 1 << ((quirks & QUIRK_SHIFT_USES_VY) ? inst_y : inst_x);
+      return 0;
+
+    case 0x0B:
+      return 1 << ((quirks & QUIRK_JUMP_VX) ? inst_x : 0);
+
+    case 0x0F:
+      if (inst_nn == 0x15 || inst_nn == 0x18 || inst_nn == 0x1E || inst_nn == 0x29 || inst_nn == 0x33)  return 1 << inst_x;
+      if (inst_nn == 0x55)                                                                                return (2 << inst_x) - 1;
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+
+// Print registers, timers and the subroutine stack
+void debug_print_registers(debugger_params_t* dbg, chip8_t* c8)
+{
+  fprintf(dbg->out, "PC=%03X [%04X]  I=%03X  DT=%02X  ST=%02X\n", c8->emu_pc, debug_opcode_at(c8, c8->emu_pc), c8->emu_I, c8->emu_delayTimer, c8->emu_soundTimer);
+
+  for (uint8_t i=0; i<16; i++)
+    fprintf(dbg->out, "V%X=%02X%s", i, c8->emu_V[i], (i % 8 == 7) ? "\n" : "  ");
+
+  fprintf(dbg->out, "Stack:");
+  for (uint16_t* entry=&c8->emu_subrStack[0]; entry<c8->emu_subrStack_ptr; entry++)
+    fprintf(dbg->out, " %03X", *entry);
+  fprintf(dbg->out, "%s\n", (c8->emu_subrStack_ptr == &c8->emu_subrStack[0]) ? " (empty)" : "");
+}
+
+
+// Hex dump length bytes of RAM starting at addr
+static void debug_print_memory(debugger_params_t* dbg, chip8_t* c8, uint16_t addr, uint16_t length)
+{
+  for (uint16_t offset=0; offset<length; offset++)
+  {
+    const uint16_t current = (addr + offset) & 0x0FFF;
+
+    if (offset % 16 == 0)
+      fprintf(dbg->out, "%s%03X:", offset ? "\n" : "", current);
+
+    fprintf(dbg->out, " %02X", c8->emu_ram[current]);
+  }
+  fprintf(dbg->out, "\n");
+}
+
+
+// Stop emulation and show where we are
+void debug_break(debugger_params_t* dbg, chip8_t* c8, const char* reason)
+{
+  c8->emu_state = DEBUG_BREAK;
+  dbg->step_mode = STEP_NONE;
+  dbg->resuming = true;
+  dbg->console_waiting = false;
+  debug_update_armed(dbg);
+
+  fprintf(dbg->out, "Break (%s)\n", reason);
+  debug_print_registers(dbg, c8);
+  fflush(dbg->out);
+}
+
+
+// Leave DEBUG_BREAK, optionally stepping a single instruction (into or over)
+void debug_resume(debugger_params_t* dbg, chip8_t* c8, debug_step_t step_mode)
+{
+  // Stepping over anything but a 2NNN call is just a single step
+  if (step_mode == STEP_OVER && (debug_opcode_at(c8, c8->emu_pc) & 0xF000) != 0x2000)
+    step_mode = STEP_INTO;
+
+  dbg->step_mode = step_mode;
+  dbg->step_over_pc = c8->emu_pc + 2;
+  dbg->step_over_stack_ptr = c8->emu_subrStack_ptr;
+  debug_update_armed(dbg);
+
+  c8->emu_state = RUNNING;
+}
+
+
+// Toggle a breakpoint at addr
+void debug_toggle_breakpoint(debugger_params_t* dbg, uint16_t addr)
+{
+  addr &= 0x0FFF;
+
+  if (debug_has_breakpoint(dbg, addr))
+  {
+    dbg->pc_breakpoints[addr / 8] &= ~(1 << (addr % 8));
+    dbg->num_pc_breakpoints--;
+    fprintf(dbg->out, "Breakpoint at %03X removed\n", addr);
+  }
+  else
+  {
+    dbg->pc_breakpoints[addr / 8] |= (1 << (addr % 8));
+    dbg->num_pc_breakpoints++;
+    fprintf(dbg->out, "Breakpoint at %03X set\n", addr);
+  }
+
+  debug_update_armed(dbg);
+  fflush(dbg->out);
+}
+
+
+// Listen for TCP console clients on 127.0.0.1 (one at a time, others wait in the backlog)
+static bool debug_listen(debugger_params_t* dbg, uint16_t port)
+{
+  const struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  const int reuse = 1;
+
+  dbg->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (dbg->listen_fd < 0 || setsockopt(dbg->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+      bind(dbg->listen_fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(dbg->listen_fd, 1) != 0)
+  {
+    SDL_Log("Could not open debugger port %u ... exiting! %s", (unsigned int)port, strerror(errno));
+    if (dbg->listen_fd >= 0)
+      close(dbg->listen_fd);
+    dbg->listen_fd = -1;
+    return false;
+  }
+
+  // A client that goes away mid reply must not take the emulator down with it
+  signal(SIGPIPE, SIG_IGN);
+
+  SDL_Log("Debugger console listening on 127.0.0.1:%u", (unsigned int)port);
+  return true;
+}
+
+
+// Drop the TCP client, output goes back to stdout until the next one connects
+static void debug_close_client(debugger_params_t* dbg)
+{
+  if (dbg->out != stdout)
+    fclose(dbg->out);
+
+  dbg->out = stdout;
+  dbg->console_fd = -1;
+  dbg->console_line_len = 0;
+  dbg->console_waiting = false;
+}
+
+
+// Set up the debugger from the user configuration (false if the TCP console port could not be opened)
+bool init_debugger(debugger_params_t* dbg, user_config_params_t* cfg)
+{
+  memset(dbg, 0, sizeof(*dbg));
+  dbg->out = stdout;
+  dbg->listen_fd = -1;
+  dbg->console_fd = -1;
+
+  if (cfg->debug_port != 0)
+  {
+    if (!debug_listen(dbg, (uint16_t)cfg->debug_port))
+      return false;
+    dbg->console = true;
+  }
+  else if (cfg->debug_console)
+  {
+    dbg->console = true;
+    dbg->console_fd = STDIN_FILENO;
+  }
+
+  if (cfg->debug_break_pc >= 0)
+    debug_toggle_breakpoint(dbg, (uint16_t)cfg->debug_break_pc);
+
+  if (dbg->console_fd == STDIN_FILENO)
+  {
+    puts("Debugger console ready (h for help)");
+    fflush(stdout);
+  }
+  return true;
+}
+
+
+// Close the TCP console
+void close_debugger(debugger_params_t* dbg)
+{
+  if (dbg->console_fd >= 0 && dbg->console_fd != STDIN_FILENO)
+    debug_close_client(dbg);
+
+  if (dbg->listen_fd >= 0)
+    close(dbg->listen_fd);
+  dbg->listen_fd = -1;
+}
+
+
+// Checked version of the per frame instruction loop, stops early (state DEBUG_BREAK) on a breakpoint, watchpoint or finished step
+void debug_emulate_instructions(debugger_params_t* dbg, chip8_t* c8, user_config_params_t* cfg, uint32_t num_instructions)
+{
+  char reason[64];
+
+  for (uint32_t i=0; i<num_instructions && c8->emu_state == RUNNING; i++)
+  {
+    const uint16_t pc = c8->emu_pc;
+    const uint16_t opcode = debug_opcode_at(c8, pc);
+
+    if (!dbg->resuming && debug_has_breakpoint(dbg, pc))
+    {
+      snprintf(reason, sizeof(reason), "breakpoint at %03X", pc);
+      debug_break(dbg, c8, reason);
+      return;
+    }
+
+    // The one instruction resumed over is this one, whatever stops or steps after it
+    if (dbg->resuming)
+    {
+      dbg->resuming = false;
+      debug_update_armed(dbg);
+    }
+
+    // The access range depends on I before the instruction runs
+    uint16_t access_start = 0, access_end = 0;
+    bool access_is_write = false;
+    const bool accesses_ram = (dbg->num_ram_watchpoints > 0) && debug_ram_access(c8, opcode, &access_start, &access_end, &access_is_write);
+
+    if (dbg->tracer != NULL && dbg->tracer->active)
+      trace_emulate_instruction(dbg->tracer, c8, cfg);
+    else
+      emulate_instructions(c8, cfg);
+
+    for (uint32_t w=0; accesses_ram && w<dbg->num_ram_watchpoints; w++)
+    {
+      const debug_watchpoint_t* watch = &dbg->ram_watchpoints[w];
+      const bool kind_matches = access_is_write ? watch->on_write : watch->on_read;
+
+      if (kind_matches && access_start <= watch->end && access_end >= watch->start)
+      {
+        snprintf(reason, sizeof(reason), "%s of %03X-%03X by %04X at %03X", access_is_write ? "write" : "read", access_start, access_end, opcode, pc);
+        debug_break(dbg, c8, reason);
+        return;
+      }
+    }
+
+    // FX0A only writes VX once a key is pressed (the PC moves on)
+    uint16_t written_v = debug_written_v_mask(opcode) & dbg->v_watch_mask;
+    if ((opcode & 0xF0FF) == 0xF00A && c8->emu_pc == pc)
+      written_v = 0;
+
+    const uint16_t read_v = debug_read_v_mask(opcode, cfg->quirks) & dbg->v_read_watch_mask;
+
+    if (written_v != 0 || read_v != 0)
+    {
+      snprintf(reason, sizeof(reason), "V%X %s by %04X at %03X", __builtin_ctz(written_v ? written_v : read_v), written_v ? "written" : "read", opcode, pc);
+      debug_break(dbg, c8, reason);
+      return;
+    }
+
+    if (dbg->step_mode == STEP_INTO ||
+        (dbg->step_mode == STEP_OVER && c8->emu_pc == dbg->step_over_pc && c8->emu_subrStack_ptr == dbg->step_over_stack_ptr))
+    {
+      debug_break(dbg, c8, "step");
+      return;
+    }
+  }
+}
+
+
+// Run one console command
+static void debug_run_command(debugger_params_t* dbg, chip8_t* c8, char* line)
+{
+  char command[16] = {0};
+  char arg_1[16] = {0}, arg_2[16] = {0}, arg_3[16] = {0};
+  const int num_args = sscanf(line, "%15s %15s %15s %15s", command, arg_1, arg_2, arg_3) - 1;
+
+  if (num_args < 0)
+    return;
+
+  const bool stopped = (c8->emu_state == DEBUG_BREAK);
+  const uint16_t addr_1 = strtoul(arg_1, NULL, 16) & 0x0FFF;
+
+  if (strcmp(command, "h") == 0)
+  {
+    fputs("b ADDR          toggle breakpoint        bl        list breakpoints/watchpoints\n"
+          "w ADDR [LEN] [r|w|rw]  watch RAM         wv X [r|w|rw]  watch VX (writes by default)\n"
+          "dw N            delete watchpoint N      dv X      stop watching VX\n"
+          "p               break now                c         continue\n"
+          "s               step into                n         step over (2NNN)\n"
+          "r               registers and stack      m ADDR [LEN]  memory dump\n", dbg->out);
+  }
+
+  else if (strcmp(command, "b") == 0 && num_args >= 1)
+    debug_toggle_breakpoint(dbg, addr_1);
+
+  else if (strcmp(command, "bl") == 0)
+  {
+    for (uint16_t addr=0; addr<4096; addr++)
+    {
+      if (debug_has_breakpoint(dbg, addr))
+        fprintf(dbg->out, "Breakpoint %03X\n", addr);
+    }
+
+    for (uint32_t w=0; w<dbg->num_ram_watchpoints; w++)
+    {
+      const debug_watchpoint_t* watch = &dbg->ram_watchpoints[w];
+      fprintf(dbg->out, "Watchpoint %u: %03X-%03X %s%s\n", (unsigned int)w, watch->start, watch->end, watch->on_read ? "r" : "", watch->on_write ? "w" : "");
+    }
+
+    for (uint8_t i=0; i<16; i++)
+    {
+      if ((dbg->v_watch_mask | dbg->v_read_watch_mask) & (1 << i))
+        fprintf(dbg->out, "Watching V%X %s%s\n", i, (dbg->v_read_watch_mask & (1 << i)) ? "r" : "", (dbg->v_watch_mask & (1 << i)) ? "w" : "");
+    }
+  }
+
+  else if (strcmp(command, "w") == 0 && num_args >= 1)
+  {
+    if (dbg->num_ram_watchpoints >= DEBUG_MAX_WATCHPOINTS)
+    {
+      fprintf(dbg->out, "Too many watchpoints (max %d)\n", DEBUG_MAX_WATCHPOINTS);
+    }
+    else
+    {
+      const uint16_t length = (num_args >= 2) ? strtoul(arg_2, NULL, 0) : 1;
+      const char* kind = (num_args >= 3) ? arg_3 : "w";
+
+      debug_watchpoint_t* watch = &dbg->ram_watchpoints[dbg->num_ram_watchpoints++];
+      watch->start = addr_1;
+      watch->end = addr_1 + (length ? length : 1) - 1;
+      watch->on_read = (strchr(kind, 'r') != NULL);
+      watch->on_write = (strchr(kind, 'w') != NULL);
+      fprintf(dbg->out, "Watchpoint %u: %03X-%03X\n", (unsigned int)(dbg->num_ram_watchpoints - 1), watch->start, watch->end);
+    }
+  }
+
+  else if (strcmp(command, "dw") == 0 && num_args >= 1)
+  {
+    const uint32_t index = strtoul(arg_1, NULL, 0);
+    if (index < dbg->num_ram_watchpoints)
+    {
+      memmove(&dbg->ram_watchpoints[index], &dbg->ram_watchpoints[index + 1], (dbg->num_ram_watchpoints - index - 1) * sizeof(debug_watchpoint_t));
+      dbg->num_ram_watchpoints--;
+    }
+  }
+
+  else if (strcmp(command, "wv") == 0 && num_args >= 1)
+  {
+    const uint16_t v_bit = 1 << (strtoul(arg_1, NULL, 16) & 0x0F);
+    const char* kind = (num_args >= 2) ? arg_2 : "w";
+
+    if (strchr(kind, 'r') != NULL)
+      dbg->v_read_watch_mask |= v_bit;
+    if (strchr(kind, 'w') != NULL)
+      dbg->v_watch_mask |= v_bit;
+  }
+
+  else if (strcmp(command, "dv") == 0 && num_args >= 1)
+  {
+    const uint16_t v_bit = 1 << (strtoul(arg_1, NULL, 16) & 0x0F);
+    dbg->v_watch_mask &= ~v_bit;
+    dbg->v_read_watch_mask &= ~v_bit;
+  }
+
+  else if (strcmp(command, "p") == 0 && !stopped)
+    debug_break(dbg, c8, "user");
+
+  else if (strcmp(command, "c") == 0 && stopped)
+    debug_resume(dbg, c8, STEP_NONE);
+
+  // Commands typed after a step wait until the step has finished
+  else if (strcmp(command, "s") == 0 && stopped)
+  {
+    debug_resume(dbg, c8, STEP_INTO);
+    dbg->console_waiting = true;
+  }
+
+  else if (strcmp(command, "n") == 0 && stopped)
+  {
+    debug_resume(dbg, c8, STEP_OVER);
+    dbg->console_waiting = true;
+  }
+
+  else if (strcmp(command, "r") == 0)
+    debug_print_registers(dbg, c8);
+
+  else if (strcmp(command, "m") == 0 && num_args >= 1)
+    debug_print_memory(dbg, c8, addr_1, (num_args >= 2) ? strtoul(arg_2, NULL, 0) : 64);
+
+  else
+    fprintf(dbg->out, "Unknown command (or not available while %s): %s\n", stopped ? "stopped" : "running", command);
+
+  debug_update_armed(dbg);
+  fflush(dbg->out);
+}
+
+
+// Run buffered complete lines, holding them back while a console step is still running
+static void debug_run_console_lines(debugger_params_t* dbg, chip8_t* c8)
+{
+  char* line = dbg->console_line;
+  char* newline;
+
+  while (!dbg->console_waiting && (newline = strchr(line, '\n')) != NULL)
+  {
+    *newline = '\0';
+    debug_run_command(dbg, c8, line);
+    line = newline + 1;
+  }
+
+  dbg->console_line_len = strlen(line);
+  memmove(dbg->console_line, line, dbg->console_line_len + 1);
+}
+
+
+// Accept a TCP console client, then read and run any complete commands typed on the console
+void debug_poll_console(debugger_params_t* dbg, chip8_t* c8)
+{
+  // No TCP client yet, take the next one waiting
+  if (dbg->console_fd < 0)
+  {
+    struct pollfd listen_poll = {.fd = dbg->listen_fd, .events = POLLIN};
+    if (poll(&listen_poll, 1, 0) <= 0)
+      return;
+
+    const int client_fd = accept(dbg->listen_fd, NULL, NULL);
+    if (client_fd < 0)
+      return;
+
+    FILE* client_out = fdopen(client_fd, "w");
+    if (client_out == NULL)
+    {
+      close(client_fd);
+      return;
+    }
+
+    dbg->console_fd = client_fd;
+    dbg->out = client_out;
+    fputs("Debugger console ready (h for help)\n", dbg->out);
+    if (c8->emu_state == DEBUG_BREAK)
+      debug_print_registers(dbg, c8);
+    fflush(dbg->out);
+  }
+
+  struct pollfd console_poll = {.fd = dbg->console_fd, .events = POLLIN};
+
+  // Lines held back by an earlier step can run once it has stopped
+  debug_run_console_lines(dbg, c8);
+
+  while (dbg->console_line_len < sizeof(dbg->console_line) - 1 && poll(&console_poll, 1, 0) > 0)
+  {
+    const size_t space = sizeof(dbg->console_line) - 1 - dbg->console_line_len;
+    const ssize_t num_read = read(dbg->console_fd, &dbg->console_line[dbg->console_line_len], space);
+
+    // stdin closed, stop polling it (a TCP client hanging up frees the port for the next one)
+    if (num_read <= 0)
+    {
+      if (dbg->listen_fd >= 0)
+        debug_close_client(dbg);
+      else
+        dbg->console = false;
+      return;
+    }
+
+    dbg->console_line_len += num_read;
+    dbg->console_line[dbg->console_line_len] = '\0';
+    debug_run_console_lines(dbg, c8);
+
+    // Overlong line with no newline, drop it
+    if (dbg->console_line_len == sizeof(dbg->console_line) - 1 && strchr(dbg->console_line, '\n') == NULL)
+      dbg->console_line_len = 0;
+  }
+}
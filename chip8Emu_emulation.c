@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -7,18 +9,21 @@
 
 #include "chip8Emu.h"
 
+// How long before a deadline wait_until stops sleeping and spins (enough to cover the OS waking a sleep late)
+#define WAIT_SPIN_NS  100000
+
 
 
 // Get User Input
-void handle_user_input(chip8_t* c8)
+void handle_user_input(chip8_t* c8, user_config_params_t* cfg, debugger_params_t* dbg, input_latency_t* latency)
 {
   SDL_Event main_events;
 
-  // Chip8 Keypad:
-  // 123C     1234
-  // 456D     QWER
-  // 789E     ASDF
-  // A0BF     ZXCV
+  // Chip8 Keypad:      Default keymap (cfg->keymap):
+  // 123C               1234
+  // 456D               QWER
+  // 789E               ASDF
+  // A0BF               ZXCV
 
   while (SDL_PollEvent(&main_events))
   {
@@ -49,55 +54,43 @@ void handle_user_input(chip8_t* c8)
 
         case SDLK_ESCAPE:   c8->emu_state = QUIT;   return;
 
-        case SDLK_1:  c8->emu_keypad[0x01] = true;  break;
-        case SDLK_2:  c8->emu_keypad[0x02] = true;  break;
-        case SDLK_3:  c8->emu_keypad[0x03] = true;  break;
-        case SDLK_4:  c8->emu_keypad[0x0C] = true;  break;
-
-        case SDLK_q:  c8->emu_keypad[0x04] = true;  break;
-        case SDLK_w:  c8->emu_keypad[0x05] = true;  break;
-        case SDLK_e:  c8->emu_keypad[0x06] = true;  break;
-        case SDLK_r:  c8->emu_keypad[0x0D] = true;  break;
-
-        case SDLK_a:  c8->emu_keypad[0x07] = true;  break;
-        case SDLK_s:  c8->emu_keypad[0x08] = true;  break;
-        case SDLK_d:  c8->emu_keypad[0x09] = true;  break;
-        case SDLK_f:  c8->emu_keypad[0x0E] = true;  break;
-
-        case SDLK_z:  c8->emu_keypad[0x0A] = true;  break;
-        case SDLK_x:  c8->emu_keypad[0x00] = true;  break;
-        case SDLK_c:  c8->emu_keypad[0x0B] = true;  break;
-        case SDLK_v:  c8->emu_keypad[0x0F] = true;  break;
-        
-        default:  break;
+        // Debugger: F5 continue, F6 break, F9 toggle breakpoint at PC, F10 step over, F11 step into
+        case SDLK_F5:   if (c8->emu_state == DEBUG_BREAK) debug_resume(dbg, c8, STEP_NONE);   break;
+        case SDLK_F6:   if (c8->emu_state == RUNNING) debug_break(dbg, c8, "user");           break;
+        case SDLK_F9:   debug_toggle_breakpoint(dbg, c8->emu_pc);                              break;
+        case SDLK_F10:  if (c8->emu_state == DEBUG_BREAK) debug_resume(dbg, c8, STEP_OVER);   break;
+        case SDLK_F11:  if (c8->emu_state == DEBUG_BREAK) debug_resume(dbg, c8, STEP_INTO);   break;
+
+        // F8 writes out the flight recorder trace
+        case SDLK_F8:   if (dbg->tracer != NULL) trace_dump(dbg->tracer);                      break;
+
+        default:
+        {
+          for (uint8_t key=0; key<16; key++)
+          {
+            if (main_events.key.keysym.sym != cfg->keymap[key])
+              continue;
+
+            c8->emu_keypad[key] = true;
+
+            // Latency is timed from when SDL queued the press, so time spent waiting in the queue counts
+            if (!main_events.key.repeat && !latency->pending)
+            {
+              latency->pending = true;
+              latency->pending_since = main_events.key.timestamp;
+            }
+          }
+          break;
+        }
       }
     }
 
     else if (main_events.type == SDL_KEYUP)
     {
-      switch (main_events.key.keysym.sym)
+      for (uint8_t key=0; key<16; key++)
       {
-        case SDLK_1:  c8->emu_keypad[0x01] = false; break;
-        case SDLK_2:  c8->emu_keypad[0x02] = false;  break;
-        case SDLK_3:  c8->emu_keypad[0x03] = false;  break;
-        case SDLK_4:  c8->emu_keypad[0x0C] = false;  break;
-
-        case SDLK_q:  c8->emu_keypad[0x04] = false;  break;
-        case SDLK_w:  c8->emu_keypad[0x05] = false;  break;
-        case SDLK_e:  c8->emu_keypad[0x06] = false;  break;
-        case SDLK_r:  c8->emu_keypad[0x0D] = false;  break;
-
-        case SDLK_a:  c8->emu_keypad[0x07] = false;  break;
-        case SDLK_s:  c8->emu_keypad[0x08] = false;  break;
-        case SDLK_d:  c8->emu_keypad[0x09] = false;  break;
-        case SDLK_f:  c8->emu_keypad[0x0E] = false;  break;
-
-        case SDLK_z:  c8->emu_keypad[0x0A] = false;  break;
-        case SDLK_x:  c8->emu_keypad[0x00] = false;  break;
-        case SDLK_c:  c8->emu_keypad[0x0B] = false;  break;
-        case SDLK_v:  c8->emu_keypad[0x0F] = false;  break;
-
-        default:  break;
+        if (main_events.key.keysym.sym == cfg->keymap[key])
+          c8->emu_keypad[key] = false;
       }
     }
 
@@ -220,36 +213,41 @@ void emulate_instructions(chip8_t* c8, user_config_params_t* cfg)
       else if (inst_n == 0x03)
         c8->emu_V[inst_x] ^= c8->emu_V[inst_y];      // 8XY3: Set VX equal to VX XOR VY
 
-      else if (inst_n == 0x04)                                 // 8XY4: Set VX += VY and set VF to 1 if carry
+      // Flag ops take the flag from the original operands and write VF last, so the flag wins when X is F
+      else if (inst_n == 0x04)                                 // 8XY4: Set VX += VY and set VF to 1 if carry, 0 if not
       {
-        if ((uint16_t)(c8->emu_V[inst_x] + c8->emu_V[inst_y]) > 255)
-          c8->emu_V[0x0F] = 1;
-          
+        const bool carry = (uint16_t)(c8->emu_V[inst_x] + c8->emu_V[inst_y]) > 255;
         c8->emu_V[inst_x] += c8->emu_V[inst_y];
+        c8->emu_V[0x0F] = carry;
       }
 
       else if (inst_n == 0x05)                                 // 8XY5: Set VX -= VY and set VF to 1 if no borrow
       {
-        c8->emu_V[0x0F] = (c8->emu_V[inst_x] >= c8->emu_V[inst_y]); 
+        const bool no_borrow = (c8->emu_V[inst_x] >= c8->emu_V[inst_y]);
         c8->emu_V[inst_x] -= c8->emu_V[inst_y];
+        c8->emu_V[0x0F] = no_borrow;
       }
 
       else if (inst_n == 0x06)                                 // 8XY6: Store LSb of VX in VF amd shift VX right by 1
       {
-        c8->emu_V[0x0F] = c8->emu_V[inst_x] & 0x01;
-        c8->emu_V[inst_x] >>= 1;
+        // COSMAC VIP shifts VY into VX
+        const uint8_t source = (cfg->quirks & QUIRK_SHIFT_USES_VY) ? c8->emu_V[inst_y] : c8->emu_V[inst_x];
+        c8->emu_V[inst_x] = source >> 1;
+        c8->emu_V[0x0F] = source & 0x01;
       }
 
       else if (inst_n == 0x07)                                 // 8XY7: Set VX = VY - vX and set VF to 1 if no borrow
       {
-        c8->emu_V[0x0F] = (c8->emu_V[inst_y] >= c8->emu_V[inst_x]);  
+        const bool no_borrow = (c8->emu_V[inst_y] >= c8->emu_V[inst_x]);
         c8->emu_V[inst_x] = c8->emu_V[inst_y] - c8->emu_V[inst_x];
+        c8->emu_V[0x0F] = no_borrow;
       }
 
       else if (inst_n == 0x0E)                                 // 8XYE: Store MSb of VX in VF amd shift VX left by 1
       {
-        c8->emu_V[0x0F] = (c8->emu_V[inst_x] & 0x80) >> 7;
-        c8->emu_V[inst_x] <<= 1;
+        const uint8_t source = (cfg->quirks & QUIRK_SHIFT_USES_VY) ? c8->emu_V[inst_y] : c8->emu_V[inst_x];
+        c8->emu_V[inst_x] = source << 1;
+        c8->emu_V[0x0F] = (source & 0x80) >> 7;
       }
 
       else
@@ -257,6 +255,10 @@ void emulate_instructions(chip8_t* c8, user_config_params_t* cfg)
         // Wrong OPCODE
       }
 
+      // COSMAC VIP logic ops leave VF cleared
+      if ((cfg->quirks & QUIRK_VF_RESET) && inst_n >= 0x01 && inst_n <= 0x03)
+        c8->emu_V[0x0F] = 0;
+
       break;
     }
 
@@ -275,15 +277,15 @@ void emulate_instructions(chip8_t* c8, user_config_params_t* cfg)
       break;
     }
 
-    case 0x0B:       // BNNN: Jump to V0 + NNN
+    case 0x0B:       // BNNN: Jump to V0 + NNN (BXNN: XNN + VX on CHIP-48/SCHIP)
     {
-      c8->emu_pc = c8->emu_V[0] + inst_nnn;
+      c8->emu_pc = c8->emu_V[(cfg->quirks & QUIRK_JUMP_VX) ? inst_x : 0] + inst_nnn;
       break;
     }
 
     case 0x0C:       // CXNN: VX = rand() & NN
     {
-      c8->emu_V[inst_x] = (rand() % 256) & (inst_nn);
+      c8->emu_V[inst_x] = chip8_random_byte(&c8->emu_rng_state) & (inst_nn);
       break;
     }
 
@@ -413,6 +415,10 @@ void emulate_instructions(chip8_t* c8, user_config_params_t* cfg)
         {
           c8->emu_ram[c8->emu_I + i] = c8->emu_V[i];
         }
+
+        // COSMAC VIP leaves I past the last register stored
+        if (cfg->quirks & QUIRK_MEMORY_INCREMENT)
+          c8->emu_I += inst_x + 1;
       }
 
       else if (inst_nn == 0x65)        // FX65:  Load V regs from V0 to VX from mem offset from I
@@ -421,6 +427,9 @@ void emulate_instructions(chip8_t* c8, user_config_params_t* cfg)
         {
           c8->emu_V[i] = c8->emu_ram[c8->emu_I + i]; 
         }
+
+        if (cfg->quirks & QUIRK_MEMORY_INCREMENT)
+          c8->emu_I += inst_x + 1;
       }
 
       else
@@ -454,46 +463,50 @@ void update_window(sdl_params_t* sdl_params, user_config_params_t* cfg, chip8_t*
   uint8_t bg_b = (cfg->bg_color >> (32-24)) & 0xFF;
   uint8_t bg_a = (cfg->bg_color >> (32-32)) & 0xFF;
 
-  // Render the text in the top 10% of the screen
+  // Render the text in the top 10% of the screen (the font is loaded once by init_sdl)
   const char* emulator_name = "Chip8Emu"; // Your emulator name
-  TTF_Font* font = TTF_OpenFont("Poxast-R9.ttf", 40); // Load a font
-  if (font == NULL) 
+  if (sdl_params->title_font != NULL)
   {
-    // Handle error if the font cannot be loaded
-    printf("Error loading font: %s\n", TTF_GetError());
-    return;
+    // Render text surface
+    SDL_Color text_color = {255, 255, 255, 255}; // Use the foreground color for the text
+    SDL_Surface* text_surface = TTF_RenderText_Blended(sdl_params->title_font, emulator_name, text_color);
+    if (text_surface == NULL) 
+    {
+      // Handle error if text rendering fails
+      printf("Error rendering text: %s\n", TTF_GetError());
+    }
+    else
+    {
+      // Create a texture from the surface
+      SDL_Texture* text_texture = SDL_CreateTextureFromSurface(sdl_params->main_renderer, text_surface);
+      SDL_FreeSurface(text_surface); // Free the surface as it's no longer needed
+
+      // Get the width and height of the text texture
+      int text_width = 0, text_height = 0;
+      SDL_QueryTexture(text_texture, NULL, NULL, &text_width, &text_height);
+
+      // Set the position to display the text in the top 10% of the window
+      SDL_Rect text_rect = { 
+          .x = (cfg->side_border) * cfg->scale_factor,
+          .y = 0, // Place it at the top of the screen
+          .w = text_width,
+          .h = text_height
+      };
+
+      // Render the text texture
+      SDL_RenderCopy(sdl_params->main_renderer, text_texture, NULL, &text_rect);
+      SDL_DestroyTexture(text_texture); // Free the texture after rendering
+    }
   }
 
-  // Render text surface
-  SDL_Color text_color = {255, 255, 255, 255}; // Use the foreground color for the text
-  SDL_Surface* text_surface = TTF_RenderText_Blended(font, emulator_name, text_color);
-  if (text_surface == NULL) 
+  // Filtered modes scale the whole display on the CPU and upload it as one texture
+  if (sdl_params->render != NULL)
   {
-    // Handle error if text rendering fails
-    printf("Error rendering text: %s\n", TTF_GetError());
+    render_filtered_frame(sdl_params, cfg, c8);
+    SDL_RenderPresent(sdl_params->main_renderer);
     return;
   }
 
-  // Create a texture from the surface
-  SDL_Texture* text_texture = SDL_CreateTextureFromSurface(sdl_params->main_renderer, text_surface);
-  SDL_FreeSurface(text_surface); // Free the surface as it's no longer needed
-
-  // Get the width and height of the text texture
-  int text_width = 0, text_height = 0;
-  SDL_QueryTexture(text_texture, NULL, NULL, &text_width, &text_height);
-
-  // Set the position to display the text in the top 10% of the window
-  SDL_Rect text_rect = { 
-      .x = (cfg->side_border) * cfg->scale_factor,
-      .y = 0, // Place it at the top of the screen
-      .w = text_width,
-      .h = text_height
-  };
-
-  // Render the text texture
-  SDL_RenderCopy(sdl_params->main_renderer, text_texture, NULL, &text_rect);
-  SDL_DestroyTexture(text_texture); // Free the texture after rendering
-
   // Render main game display
   for (uint32_t i=0; i<(sizeof(c8->emu_display)); i++)
   {
@@ -524,7 +537,6 @@ void update_window(sdl_params_t* sdl_params, user_config_params_t* cfg, chip8_t*
   }
 
   SDL_RenderPresent(sdl_params->main_renderer);
-  TTF_CloseFont(font);
 }
 
 
@@ -541,4 +553,152 @@ void update_timers(chip8_t* c8)
   {
     // Stop Playing sound
   }
-}
\ No newline at end of file
+}
+
+
+// Sleep until the performance counter reaches target (asleep until the last WAIT_SPIN_NS, spinning only for those)
+void wait_until(uint64_t target_counter)
+{
+  const uint64_t frequency = SDL_GetPerformanceFrequency();
+  const uint64_t spin_counts = frequency * WAIT_SPIN_NS / 1000000000;
+  uint64_t now = SDL_GetPerformanceCounter();
+
+  // A sleep can end early (signals) or late (timer slack), so re-read the counter and sleep again until inside the spin margin
+  while (now + spin_counts < target_counter)
+  {
+    const uint64_t sleep_ns = (target_counter - now - spin_counts) * 1000000000 / frequency;
+    const struct timespec sleep_time = {.tv_sec = sleep_ns / 1000000000, .tv_nsec = sleep_ns % 1000000000};
+
+    nanosleep(&sleep_time, NULL);
+    now = SDL_GetPerformanceCounter();
+  }
+
+  while (SDL_GetPerformanceCounter() < target_counter) {}
+}
+
+
+// Sleep until the next 60Hz frame deadline and advance it (deadline 0 starts pacing from now)
+void wait_for_frame_deadline(uint64_t* frame_deadline)
+{
+  const uint64_t frame_period = SDL_GetPerformanceFrequency() / 60;
+
+  if (*frame_deadline == 0)
+    *frame_deadline = SDL_GetPerformanceCounter();
+
+  wait_until(*frame_deadline);
+
+  // More than a frame behind (window drag, breakpoint, ...): restart pacing instead of running frames back to back
+  const uint64_t now = SDL_GetPerformanceCounter();
+  *frame_deadline += frame_period;
+  if (*frame_deadline + frame_period < now)
+    *frame_deadline = now + frame_period;
+}
+
+
+// Take a latency sample if a key press is waiting for this frame to be presented
+void record_input_latency(input_latency_t* latency)
+{
+  if (!latency->pending)
+    return;
+
+  const uint32_t latency_ms = SDL_GetTicks() - latency->pending_since;
+  latency->pending = false;
+
+  latency->num_samples++;
+  latency->total_ms += latency_ms;
+  if (latency_ms > latency->max_ms)
+    latency->max_ms = latency_ms;
+
+  latency->histogram[latency_ms < LATENCY_HISTOGRAM_BUCKETS ? latency_ms : LATENCY_HISTOGRAM_BUCKETS - 1]++;
+}
+
+
+// Print the input-to-present latency summary
+void report_input_latency(input_latency_t* latency)
+{
+  if (latency->num_samples == 0)
+  {
+    printf("Input latency: no key presses recorded\n");
+    return;
+  }
+
+  // Percentiles from the 1 ms histogram
+  uint32_t p50 = 0, p99 = 0, seen = 0;
+  for (uint32_t i=0; i<LATENCY_HISTOGRAM_BUCKETS; i++)
+  {
+    if (seen < (latency->num_samples + 1) / 2 && seen + latency->histogram[i] >= (latency->num_samples + 1) / 2)
+      p50 = i;
+    if (seen < (latency->num_samples * 99 + 99) / 100 && seen + latency->histogram[i] >= (latency->num_samples * 99 + 99) / 100)
+      p99 = i;
+    seen += latency->histogram[i];
+  }
+
+  printf("Input latency over %u presses: mean %.1f ms, p50 %u ms, p99 %u ms, max %u ms\n", (unsigned int)latency->num_samples,
+         (double)latency->total_ms / latency->num_samples, (unsigned int)p50, (unsigned int)p99, (unsigned int)latency->max_ms);
+}
+
+
+// Mix 8 bytes into the running state hash (multiply / xor-shift, not cryptographic)
+static inline uint64_t hash_mix(uint64_t hash, uint64_t value)
+{
+  hash ^= value * 0x9E3779B97F4A7C15ull;
+  hash = (hash ^ (hash >> 32)) * 0xD6E8FEB86659FD93ull;
+  return hash ^ (hash >> 32);
+}
+
+
+// Hash a buffer 8 bytes at a time, the tail is zero padded and tagged with its length
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t length)
+{
+  const uint8_t* bytes = data;
+  uint64_t chunk;
+
+  for (; length >= 8; length -= 8, bytes += 8)
+  {
+    memcpy(&chunk, bytes, 8);
+    hash = hash_mix(hash, chunk);
+  }
+
+  chunk = 0;
+  memcpy(&chunk, bytes, length);
+  return hash_mix(hash, chunk ^ ((uint64_t)length << 56));
+}
+
+
+// Hash the display, RAM, registers, timers and stack (same state always gives the same hash)
+uint64_t hash_chip8_state(chip8_t* c8)
+{
+  uint64_t hash = 0x43484950385F454Dull;
+
+  hash = hash_bytes(hash, c8->emu_display, sizeof(c8->emu_display));
+  hash = hash_bytes(hash, c8->emu_ram, sizeof(c8->emu_ram));
+  hash = hash_bytes(hash, c8->emu_V, sizeof(c8->emu_V));
+
+  // Stack pointer is hashed as a depth so the hash does not depend on where chip8_t lives in memory
+  const uint64_t stack_depth = c8->emu_subrStack_ptr - &c8->emu_subrStack[0];
+  hash = hash_bytes(hash, c8->emu_subrStack, stack_depth * sizeof(c8->emu_subrStack[0]));
+
+  return hash_mix(hash, ((uint64_t)c8->emu_pc << 48) | ((uint64_t)c8->emu_I << 32) |
+                        ((uint64_t)c8->emu_delayTimer << 24) | ((uint64_t)c8->emu_soundTimer << 16) | stack_depth);
+}
+
+
+
+// Random state for a seed (xorshift must never start at 0)
+// Seeds are spread by an odd multiply, otherwise small seeds give zero high bytes for the first few draws
+uint32_t chip8_random_seed(uint32_t seed)
+{
+  return seed ? seed * 0x9E3779B9u : 0x9E3779B9u;
+}
+
+
+// Next CXNN random byte, advances the xorshift32 state
+uint8_t chip8_random_byte(uint32_t* rng_state)
+{
+  uint32_t x = *rng_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *rng_state = x;
+  return x >> 24;
+}
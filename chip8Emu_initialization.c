@@ -1,15 +1,512 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <time.h>
+#include <ctype.h>
+#include <errno.h>
 
 #include "chip8Emu.h"
 
 
 
-// Initialize user configuration settings received from the CLI
+// Kinds of option in the table below, most just store their value in a config field
+typedef enum
+{
+  OPTION_FLAG = 0,        // bool field set to true
+  OPTION_FLAG_OFF = 1,    // bool field set to false
+  OPTION_UINT = 2,        // uint32_t field (decimal or 0x hex)
+  OPTION_STRING = 3,      // const char* field pointing at the value
+  OPTION_CUSTOM = 4       // parse() handles the values
+} config_option_kind_t;
+
+typedef struct
+{
+  const char* name;       // without the leading --
+  config_option_kind_t kind;
+  uint8_t num_values;
+  size_t offset;          // field in user_config_params_t (unused by OPTION_CUSTOM)
+  uint32_t cli_set;       // CFG_SET_* bits recorded when the option is given (in cli_set or config_set, by where it was given)
+  bool (*parse)(user_config_params_t* cfg, char** values);
+  const char* values_help;
+  const char* help;
+} config_option_t;
+
+#define CFG_FIELD(field) offsetof(user_config_params_t, field)
+
+
+
+// Parse a whole option value as an unsigned number up to max (base 0 takes decimal or 0x hex), naming the option if it is not one
+static bool parse_option_number(const char* option_name, const char* text, int base, unsigned long long max, unsigned long long* value)
+{
+  // strtoull skips spaces and takes a sign, neither is a valid value here
+  const bool starts_with_digit = (base == 16) ? isxdigit((unsigned char)text[0]) : isdigit((unsigned char)text[0]);
+
+  char* end = NULL;
+  errno = 0;
+  const unsigned long long parsed = starts_with_digit ? strtoull(text, &end, base) : 0;
+
+  if (!starts_with_digit || *end != '\0' || errno == ERANGE || parsed > max)
+  {
+    if (base == 16)
+      SDL_Log("--%s expects a hex number from 0 to %llX, got \"%s\"", option_name, max, text);
+    else
+      SDL_Log("--%s expects a number from 0 to %llu, got \"%s\"", option_name, max, text);
+    return false;
+  }
+
+  *value = parsed;
+  return true;
+}
+
+
+static bool parse_expect_hash(user_config_params_t* cfg, char** values)
+{
+  unsigned long long hash = 0;
+  if (!parse_option_number("expect-hash", values[0], 16, UINT64_MAX, &hash))
+    return false;
+
+  cfg->check_hash = true;
+  cfg->expected_hash = hash;
+  return true;
+}
+
+
+static bool parse_hash_diff_png(user_config_params_t* cfg, char** values)
+{
+  cfg->hash_diff_reference = values[0];
+  cfg->hash_diff_png = values[1];
+  return true;
+}
+
+
+static bool parse_break(user_config_params_t* cfg, char** values)
+{
+  unsigned long long pc = 0;
+  if (!parse_option_number("break", values[0], 16, 0x0FFF, &pc))
+    return false;
+
+  cfg->debug_break_pc = pc;
+  return true;
+}
+
+
+static bool parse_colors(user_config_params_t* cfg, char** values)
+{
+  // RRGGBBAA foreground then background
+  unsigned long long fg_color = 0;
+  unsigned long long bg_color = 0;
+  if (!parse_option_number("colors", values[0], 16, UINT32_MAX, &fg_color) ||
+      !parse_option_number("colors", values[1], 16, UINT32_MAX, &bg_color))
+    return false;
+
+  cfg->fg_color = fg_color;
+  cfg->bg_color = bg_color;
+  return true;
+}
+
+
+static bool parse_platform(user_config_params_t* cfg, char** values)
+{
+  for (rom_platform_t platform=PLATFORM_DEFAULT; platform<=PLATFORM_SCHIP; platform++)
+  {
+    if (strcmp(values[0], platform_name(platform)) == 0)
+    {
+      cfg->platform = platform;
+      return true;
+    }
+  }
+
+  SDL_Log("Unknown platform %s (use default, vip, chip48 or schip)", values[0]);
+  return false;
+}
+
+
+static bool parse_quirks(user_config_params_t* cfg, char** values)
+{
+  // Comma separated quirk names, "none", or a QUIRK_* bit mask
+  char quirk_names[256];
+  snprintf(quirk_names, sizeof(quirk_names), "%s", values[0]);
+  cfg->quirks = 0;
+
+  char* save = NULL;
+  for (char* name=strtok_r(quirk_names, ",", &save); name != NULL; name=strtok_r(NULL, ",", &save))
+  {
+    if (strcmp(name, "none") == 0)              {}
+    else if (strcmp(name, "vf-reset") == 0)     cfg->quirks |= QUIRK_VF_RESET;
+    else if (strcmp(name, "shift-vy") == 0)     cfg->quirks |= QUIRK_SHIFT_USES_VY;
+    else if (strcmp(name, "mem-inc") == 0)      cfg->quirks |= QUIRK_MEMORY_INCREMENT;
+    else if (strcmp(name, "jump-vx") == 0)      cfg->quirks |= QUIRK_JUMP_VX;
+    else if (name[0] >= '0' && name[0] <= '9')
+    {
+      unsigned long long mask = 0;
+      if (!parse_option_number("quirks", name, 0, QUIRK_VF_RESET | QUIRK_SHIFT_USES_VY | QUIRK_MEMORY_INCREMENT | QUIRK_JUMP_VX, &mask))
+        return false;
+      cfg->quirks |= mask;
+    }
+    else
+    {
+      SDL_Log("Unknown quirk %s (use vf-reset, shift-vy, mem-inc, jump-vx or none)", name);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static bool parse_no_library(user_config_params_t* cfg, char** values)
+{
+  (void)values;
+  cfg->library_path = NULL;
+  return true;
+}
+
+
+static bool parse_filter(user_config_params_t* cfg, char** values)
+{
+  for (render_filter_t filter=RENDER_RECTS; filter<=RENDER_SCALE2X; filter++)
+  {
+    if (strcmp(values[0], render_filter_name(filter)) == 0)
+    {
+      cfg->render_filter = filter;
+      return true;
+    }
+  }
+
+  SDL_Log("Unknown filter %s (use rects, nearest or scale2x)", values[0]);
+  return false;
+}
+
+
+static bool parse_phosphor(user_config_params_t* cfg, char** values)
+{
+  unsigned long long decay = 0;
+  if (!parse_option_number("phosphor", values[0], 0, 255, &decay))
+    return false;
+
+  cfg->phosphor_decay = decay;
+  return true;
+}
+
+
+static bool parse_keymap(user_config_params_t* cfg, char** values)
+{
+  // 16 comma separated SDL key names for chip8 keys 0-F, e.g. x,1,2,3,q,w,e,a,s,d,z,c,4,r,f,v
+  char key_names[256];
+  snprintf(key_names, sizeof(key_names), "%s", values[0]);
+
+  uint8_t key = 0;
+  char* save = NULL;
+  for (char* name=strtok_r(key_names, ",", &save); name != NULL; name=strtok_r(NULL, ",", &save), key++)
+  {
+    const SDL_Keycode keycode = SDL_GetKeyFromName(name);
+    if (key >= 16 || keycode == SDLK_UNKNOWN)
+    {
+      SDL_Log("Bad --keymap entry %s (need 16 SDL key names for keys 0-F)", name);
+      return false;
+    }
+    cfg->keymap[key] = keycode;
+  }
+
+  if (key != 16)
+  {
+    SDL_Log("--keymap needs 16 SDL key names for keys 0-F, got %u", (unsigned int)key);
+    return false;
+  }
+  return true;
+}
+
+
+static bool parse_capture_format(user_config_params_t* cfg, char** values)
+{
+  if (strcmp(values[0], "y4m") == 0)        cfg->capture_format = CAPTURE_Y4M;
+  else if (strcmp(values[0], "rgba") == 0)  cfg->capture_format = CAPTURE_RGBA;
+  else if (strcmp(values[0], "png") == 0)   cfg->capture_format = CAPTURE_PNG;
+  else
+  {
+    SDL_Log("Unknown capture format %s (use y4m, rgba or png)", values[0]);
+    return false;
+  }
+  return true;
+}
+
+
+
+// Every command line option (also usable in a config file without the --)
+static const config_option_t config_options[] =
+{
+  {"config",            OPTION_STRING, 1, CFG_FIELD(config_path),             0,                NULL, "FILE",      "read settings from FILE first (one option per line, no --, # comments)"},
+  {"ips",               OPTION_UINT,   1, CFG_FIELD(instructions_per_second), CFG_SET_IPS,      NULL, "N",         "instructions per second"},
+  {"vip-timing",        OPTION_FLAG,   0, CFG_FIELD(vip_timing),              0,                NULL, "",          "run frames to COSMAC VIP cycle budgets instead of --ips"},
+  {"platform",          OPTION_CUSTOM, 1, 0,                                  CFG_SET_PLATFORM, parse_platform, "NAME", "default, vip, chip48 or schip (sets its quirks)"},
+  {"quirks",            OPTION_CUSTOM, 1, 0,                                  CFG_SET_QUIRKS,   parse_quirks, "LIST",  "vf-reset,shift-vy,mem-inc,jump-vx, none or a bit mask"},
+  {"colors",            OPTION_CUSTOM, 2, 0,                                  CFG_SET_COLORS,   parse_colors, "FG BG", "RRGGBBAA foreground and background"},
+  {"keymap",            OPTION_CUSTOM, 1, 0,                                  CFG_SET_KEYMAP,   parse_keymap, "KEYS",  "16 comma separated SDL key names for keys 0-F"},
+  {"scale",             OPTION_UINT,   1, CFG_FIELD(scale_factor),            CFG_SET_SCALE,    NULL, "N",         "window pixels per chip8 pixel"},
+  {"outlines",          OPTION_FLAG,   0, CFG_FIELD(pixel_outlines),          0,                NULL, "",          "outline pixels (rects filter)"},
+  {"no-outlines",       OPTION_FLAG_OFF, 0, CFG_FIELD(pixel_outlines),        0,                NULL, "",          "no pixel outlines"},
+  {"filter",            OPTION_CUSTOM, 1, 0,                                  CFG_SET_FILTER,   parse_filter, "NAME",  "rects, nearest or scale2x"},
+  {"phosphor",          OPTION_CUSTOM, 1, 0,                                  0,                parse_phosphor, "N",   "phosphor glow decay (x/256 kept per frame)"},
+  {"input-polls",       OPTION_UINT,   1, CFG_FIELD(input_polls_per_frame),   0,                NULL, "N",         "input polls per frame"},
+  {"latency-stats",     OPTION_FLAG,   0, CFG_FIELD(latency_stats),           0,                NULL, "",          "report input latency on exit"},
+  {"autotune",          OPTION_FLAG,   0, CFG_FIELD(autotune),                0,                NULL, "",          "measure this host and save the best IPS, scale and filter as the ROM's profile"},
+  {"autotune-headroom", OPTION_UINT,   1, CFG_FIELD(autotune_headroom),       0,                NULL, "PCT",       "share of each frame autotune leaves unused"},
+  {"autotune-max-ips",  OPTION_UINT,   1, CFG_FIELD(autotune_max_ips),        0,                NULL, "N",         "highest IPS autotune will pick"},
+  {"library",           OPTION_STRING, 1, CFG_FIELD(library_path),            0,                NULL, "FILE",      "ROM library index"},
+  {"no-library",        OPTION_CUSTOM, 0, 0,                                  0,                parse_no_library, "", "do not use a ROM library"},
+  {"library-save",      OPTION_FLAG,   0, CFG_FIELD(library_save),            0,                NULL, "",          "save the current settings as the ROM's profile"},
+  {"title",             OPTION_STRING, 1, CFG_FIELD(library_title),           0,                NULL, "TITLE",     "title stored with the profile"},
+  {"headless",          OPTION_FLAG,   0, CFG_FIELD(headless),                0,                NULL, "",          "run without a window"},
+  {"uncapped",          OPTION_FLAG,   0, CFG_FIELD(uncapped),                0,                NULL, "",          "do not pace frames to 60Hz"},
+  {"frames",            OPTION_UINT,   1, CFG_FIELD(max_frames),              0,                NULL, "N",         "quit after N frames"},
+  {"seed",              OPTION_UINT,   1, CFG_FIELD(seed),                    0,                NULL, "N",         "fixed random seed"},
+  {"hash",              OPTION_FLAG,   0, CFG_FIELD(print_hash),              0,                NULL, "",          "print the machine state hash on exit"},
+  {"expect-hash",       OPTION_CUSTOM, 1, 0,                                  0,                parse_expect_hash, "HEX", "fail unless the state hash on exit is HEX"},
+  {"hash-fail-png",     OPTION_STRING, 1, CFG_FIELD(hash_fail_png),           0,                NULL, "FILE",      "write the last frame here if the hash differs"},
+  {"hash-diff-png",     OPTION_CUSTOM, 2, 0,                                  0,                parse_hash_diff_png, "REF OUT", "if the hash differs, write where the frame differs from REF"},
+  {"shm",               OPTION_STRING, 1, CFG_FIELD(shm_name),                0,                NULL, "/NAME",     "shared memory interface"},
+  {"lockstep",          OPTION_FLAG,   0, CFG_FIELD(shm_lockstep),            0,                NULL, "",          "only run frames the shared memory consumer asks for"},
+  {"batch",             OPTION_UINT,   1, CFG_FIELD(batch_lanes),             0,                NULL, "N",         "run N headless copies of the ROM"},
+  {"batch-frames",      OPTION_UINT,   1, CFG_FIELD(batch_frames),            0,                NULL, "N",         "frames per batch run"},
+  {"batch-input",       OPTION_STRING, 1, CFG_FIELD(batch_input_path),        0,                NULL, "FILE",      "per lane keys: \"FRAME LANE|* KEYS\" lines, KEYS a hex bitmap"},
+  {"input-script",      OPTION_STRING, 1, CFG_FIELD(input_script_path),       0,                NULL, "FILE",      "scripted keys: \"FRAME 0|* KEYS\" lines, KEYS a hex bitmap"},
+  {"capture",           OPTION_STRING, 1, CFG_FIELD(capture_path),            0,                NULL, "FILE",      "capture frames to FILE"},
+  {"capture-format",    OPTION_CUSTOM, 1, 0,                                  0,                parse_capture_format, "FMT", "y4m, rgba or png"},
+  {"capture-dedup",     OPTION_FLAG,   0, CFG_FIELD(capture_dedup),           0,                NULL, "",          "skip frames identical to the last one (PNG only)"},
+  {"debug",             OPTION_FLAG,   0, CFG_FIELD(debug_console),           0,                NULL, "",          "debugger console on stdin"},
+  {"debug-port",        OPTION_UINT,   1, CFG_FIELD(debug_port),              0,                NULL, "PORT",      "debugger console on 127.0.0.1:PORT instead of stdin"},
+  {"break",             OPTION_CUSTOM, 1, 0,                                  0,                parse_break, "ADDR",   "breakpoint at ADDR (hex)"},
+  {"trace",             OPTION_STRING, 1, CFG_FIELD(trace_path),              0,                NULL, "FILE",      "execution trace file"},
+  {"trace-flight",      OPTION_FLAG,   0, CFG_FIELD(trace_flight_recorder),   0,                NULL, "",          "keep only the last instructions, written on exit"},
+  {"trace-records",     OPTION_UINT,   1, CFG_FIELD(trace_records),           0,                NULL, "N",         "trace ring size in instructions"},
+};
+
+#define NUM_CONFIG_OPTIONS (sizeof(config_options) / sizeof(config_options[0]))
+
+
+
+// Find an option by name (without the leading --)
+static const config_option_t* find_config_option(const char* name)
+{
+  for (size_t i=0; i<NUM_CONFIG_OPTIONS; i++)
+  {
+    if (strcmp(name, config_options[i].name) == 0)
+      return &config_options[i];
+  }
+  return NULL;
+}
+
+
+// Apply one option, values are the num_values arguments after it, and record its CFG_SET_* bits in set_bits
+static bool apply_config_option(user_config_params_t* cfg, const config_option_t* option, char** values, uint32_t* set_bits)
+{
+  void* field = (char*)cfg + option->offset;
+
+  switch (option->kind)
+  {
+    case OPTION_FLAG:       *(bool*)field = true;                               break;
+    case OPTION_FLAG_OFF:   *(bool*)field = false;                              break;
+    case OPTION_UINT:
+    {
+      unsigned long long value = 0;
+      if (!parse_option_number(option->name, values[0], 0, UINT32_MAX, &value))
+        return false;
+      *(uint32_t*)field = value;
+      break;
+    }
+    case OPTION_STRING:     *(const char**)field = values[0];                  break;
+    case OPTION_CUSTOM:
+      if (!option->parse(cfg, values))
+        return false;
+      break;
+  }
+
+  *set_bits |= option->cli_set;
+  return true;
+}
+
+
+// Apply a config file: one option per line without the leading -- (e.g. "ips 700"), # starts a comment
+// Its settings are defaults (config_set), a ROM profile or autotune can still replace them, the command line cannot be
+// The file contents are kept for the life of the program since string settings point into them
+static bool load_config_file(user_config_params_t* cfg, const char* path)
+{
+  FILE* config_file = fopen(path, "rb");
+  if (config_file == NULL)
+  {
+    SDL_Log("Could not read config file %s", path);
+    return false;
+  }
+
+  fseek(config_file, 0, SEEK_END);
+  const long file_size = ftell(config_file);
+  fseek(config_file, 0, SEEK_SET);
+
+  char* text = (file_size >= 0) ? malloc(file_size + 1) : NULL;
+  if (text == NULL || fread(text, 1, file_size, config_file) != (size_t)file_size)
+  {
+    SDL_Log("Could not read config file %s", path);
+    free(text);
+    fclose(config_file);
+    return false;
+  }
+  text[file_size] = '\0';
+  fclose(config_file);
+
+  uint32_t line_number = 0;
+  for (char* line=text; line != NULL; )
+  {
+    char* next_line = strchr(line, '\n');
+    if (next_line != NULL)
+      *next_line++ = '\0';
+    line_number++;
+
+    char* comment = strchr(line, '#');
+    if (comment != NULL)
+      *comment = '\0';
+
+    // Option name then up to 7 values
+    char* tokens[8];
+    uint32_t num_tokens = 0;
+    char* save = NULL;
+    for (char* token=strtok_r(line, " \t\r", &save); token != NULL; token=strtok_r(NULL, " \t\r", &save))
+    {
+      if (num_tokens == 8)
+        break;
+      tokens[num_tokens++] = token;
+    }
+
+    line = next_line;
+    if (num_tokens == 0)
+      continue;
+
+    const char* name = (strncmp(tokens[0], "--", 2) == 0) ? tokens[0] + 2 : tokens[0];
+    const config_option_t* option = find_config_option(name);
+
+    if (option == NULL || strcmp(option->name, "config") == 0)
+    {
+      SDL_Log("%s:%u: unknown option %s", path, (unsigned int)line_number, tokens[0]);
+      return false;
+    }
+
+    if (num_tokens - 1 != option->num_values)
+    {
+      SDL_Log("%s:%u: %s needs %u value(s)", path, (unsigned int)line_number, name, (unsigned int)option->num_values);
+      return false;
+    }
+
+    if (!apply_config_option(cfg, option, &tokens[1], &cfg->config_set))
+      return false;
+  }
+
+  return true;
+}
+
+
+// Input script order is by frame, lines of the same frame keep their file order
+static int compare_input_events(const void* a, const void* b)
+{
+  const input_event_t* event_a = a;
+  const input_event_t* event_b = b;
+
+  if (event_a->frame != event_b->frame)
+    return (event_a->frame < event_b->frame) ? -1 : 1;
+
+  return (event_a->line < event_b->line) ? -1 : (event_a->line > event_b->line);
+}
+
+
+// Load an input script: "FRAME LANE KEYS" per line (LANE * = every lane, KEYS a hex bitmap held from FRAME on), # comments
+input_event_t* load_input_script(const char* path, uint32_t num_lanes, uint32_t* num_events)
+{
+  *num_events = 0;
+
+  FILE* input_file = fopen(path, "r");
+  if (input_file == NULL)
+  {
+    SDL_Log("Could not read input script %s", path);
+    return NULL;
+  }
+
+  uint32_t capacity = 64;
+  input_event_t* events = malloc(capacity * sizeof(input_event_t));
+
+  char line[256];
+  uint32_t line_number = 0;
+  bool ok = (events != NULL);
+
+  while (ok && fgets(line, sizeof(line), input_file) != NULL)
+  {
+    line_number++;
+
+    char* comment = strchr(line, '#');
+    if (comment != NULL)
+      *comment = '\0';
+
+    char lane_text[16];
+    unsigned int frame, keys;
+    const int fields = sscanf(line, "%u %15s %x", &frame, lane_text, &keys);
+    if (fields <= 0)
+      continue;
+
+    const int32_t lane = (strcmp(lane_text, "*") == 0) ? -1 : (int32_t)strtol(lane_text, NULL, 0);
+    if (fields != 3 || keys > 0xFFFF || lane >= (int32_t)num_lanes || (lane < 0 && strcmp(lane_text, "*") != 0))
+    {
+      SDL_Log("%s:%u: expected \"FRAME LANE KEYS\" with LANE below %u or *", path, (unsigned int)line_number, (unsigned int)num_lanes);
+      ok = false;
+      break;
+    }
+
+    if (*num_events == capacity)
+    {
+      capacity *= 2;
+      input_event_t* grown = realloc(events, capacity * sizeof(input_event_t));
+      if (grown == NULL)
+      {
+        ok = false;
+        break;
+      }
+      events = grown;
+    }
+
+    events[(*num_events)++] = (input_event_t){.frame = frame, .lane = lane, .keys = keys, .line = line_number};
+  }
+
+  fclose(input_file);
+
+  if (!ok)
+  {
+    free(events);
+    *num_events = 0;
+    return NULL;
+  }
+
+  qsort(events, *num_events, sizeof(input_event_t), compare_input_events);
+  return events;
+}
+
+
+// List every option with its values
+static void print_config_usage(const char* program)
+{
+  printf("Usage: %s <rom_name> [options]\n", program);
+
+  for (size_t i=0; i<NUM_CONFIG_OPTIONS; i++)
+  {
+    char option_text[48];
+    snprintf(option_text, sizeof(option_text), "--%s %s", config_options[i].name, config_options[i].values_help);
+    printf("  %-28s %s\n", option_text, config_options[i].help);
+  }
+}
+
+
+
+// Initialize user configuration settings from the defaults, an optional config file and the CLI (in that order)
 bool init_user_configuration(user_config_params_t* cfg_params, int num_args, char** args_array)
 {
   // Setup Default User Parameters
@@ -26,10 +523,153 @@ bool init_user_configuration(user_config_params_t* cfg_params, int num_args, cha
   cfg_params->fg_color = 0x33FF3300;
   cfg_params->bg_color = 0x00000000;
 
-  // If arguments are passed, override defaults
-  for (int i=0; i<num_args; i++)
+  cfg_params->shm_name = NULL;
+  cfg_params->shm_lockstep = false;
+
+  cfg_params->batch_lanes = 0;
+  cfg_params->batch_frames = 600;
+  cfg_params->batch_input_path = NULL;
+
+  cfg_params->headless = false;
+  cfg_params->uncapped = false;
+  cfg_params->max_frames = 0;
+  cfg_params->input_script_path = NULL;
+
+  cfg_params->capture_path = NULL;
+  cfg_params->capture_format = CAPTURE_Y4M;
+  cfg_params->capture_dedup = false;
+
+  cfg_params->seed = 0;
+  cfg_params->print_hash = false;
+  cfg_params->check_hash = false;
+  cfg_params->expected_hash = 0;
+  cfg_params->hash_fail_png = NULL;
+  cfg_params->hash_diff_reference = NULL;
+  cfg_params->hash_diff_png = NULL;
+
+  cfg_params->debug_console = false;
+  cfg_params->debug_port = 0;
+  cfg_params->debug_break_pc = -1;
+
+  cfg_params->trace_path = NULL;
+  cfg_params->trace_flight_recorder = false;
+  cfg_params->trace_records = 1 << 20;
+
+  // Keymap is indexed by chip8 key (0-F)
+  const SDL_Keycode default_keymap[16] =
   {
+    SDLK_x, SDLK_1, SDLK_2, SDLK_3,
+    SDLK_q, SDLK_w, SDLK_e, SDLK_a,
+    SDLK_s, SDLK_d, SDLK_z, SDLK_c,
+    SDLK_4, SDLK_r, SDLK_f, SDLK_v
+  };
+  memcpy(cfg_params->keymap, default_keymap, sizeof(default_keymap));
+
+  cfg_params->input_polls_per_frame = 1;
+  cfg_params->latency_stats = false;
+
+  cfg_params->platform = PLATFORM_DEFAULT;
+  cfg_params->quirks = 0;
+
+  cfg_params->library_path = "chip8Library.idx";
+  cfg_params->library_save = false;
+  cfg_params->library_title = NULL;
+  cfg_params->cli_set = 0;
+  cfg_params->config_set = 0;
+
+  cfg_params->render_filter = RENDER_RECTS;
+  cfg_params->phosphor_decay = 0;
+
+  cfg_params->vip_timing = false;
+
+  cfg_params->config_path = NULL;
+  cfg_params->autotune = false;
+  cfg_params->autotune_headroom = 25;
+  cfg_params->autotune_max_ips = 1000;
+  cfg_params->hidden_window = false;
+
+  // Config file first, so anything on the command line overrides it
+  for (int i=1; i+1<num_args; i++)
+  {
+    if (strcmp(args_array[i], "--config") == 0 && !load_config_file(cfg_params, args_array[i+1]))
+      return false;
+  }
+
+  for (int i=0; i<num_args; i++)
     printf("Argument %d: %s\n", i, args_array[i]);
+
+  // If arguments are passed, override defaults (anything not starting with -- is the program or ROM name)
+  for (int i=1; i<num_args; i++)
+  {
+    if (strncmp(args_array[i], "--", 2) != 0)
+      continue;
+
+    if (strcmp(args_array[i], "--help") == 0)
+    {
+      print_config_usage(args_array[0]);
+      return false;
+    }
+
+    const config_option_t* option = find_config_option(args_array[i] + 2);
+    if (option == NULL)
+    {
+      SDL_Log("Unknown option %s (--help lists them)", args_array[i]);
+      return false;
+    }
+
+    if (i + option->num_values >= num_args)
+    {
+      SDL_Log("%s needs %u value(s)", args_array[i], (unsigned int)option->num_values);
+      return false;
+    }
+
+    if (!apply_config_option(cfg_params, option, &args_array[i+1], &cfg_params->cli_set))
+      return false;
+
+    i += option->num_values;
+  }
+
+  if (cfg_params->shm_lockstep && cfg_params->shm_name == NULL)
+  {
+    SDL_Log("--lockstep needs a shared memory segment (--shm /name)");
+    return false;
+  }
+
+  if (cfg_params->debug_port > 65535)
+  {
+    SDL_Log("--debug-port %u is not a TCP port", (unsigned int)cfg_params->debug_port);
+    return false;
+  }
+
+  if (cfg_params->input_polls_per_frame == 0)
+    cfg_params->input_polls_per_frame = 1;
+
+  if (cfg_params->scale_factor == 0)
+    cfg_params->scale_factor = 1;
+
+  if (cfg_params->autotune_headroom > 90)
+    cfg_params->autotune_headroom = 90;
+
+  // A platform given without quirks brings its own quirk set (on the command line it then also beats a ROM profile)
+  if ((cfg_params->cli_set & CFG_SET_PLATFORM) && !(cfg_params->cli_set & CFG_SET_QUIRKS))
+  {
+    cfg_params->quirks = platform_default_quirks(cfg_params->platform);
+    cfg_params->cli_set |= CFG_SET_QUIRKS;
+  }
+  else if ((cfg_params->config_set & CFG_SET_PLATFORM) && !((cfg_params->config_set | cfg_params->cli_set) & CFG_SET_QUIRKS))
+  {
+    cfg_params->quirks = platform_default_quirks(cfg_params->platform);
+    cfg_params->config_set |= CFG_SET_QUIRKS;
+  }
+
+  // Phosphor glow needs the CPU scaler, plain rectangles cannot fade
+  if (cfg_params->phosphor_decay != 0 && cfg_params->render_filter == RENDER_RECTS)
+    cfg_params->render_filter = RENDER_NEAREST;
+
+  if (cfg_params->library_save && cfg_params->library_path == NULL)
+  {
+    SDL_Log("--library-save needs a library index (drop --no-library)");
+    return false;
   }
 
   return true;
@@ -53,10 +693,18 @@ bool init_sdl(sdl_params_t* sdl_parameters, user_config_params_t config_paramete
     return false;
   }
 
+  return create_sdl_window(sdl_parameters, &config_parameters);
+}
+
+
+// Create the window, renderer, title font and render filter for these settings (SDL and SDL_ttf already initialized, return true if created)
+bool create_sdl_window(sdl_params_t* sdl_parameters, user_config_params_t* cfg)
+{
   sdl_parameters->main_window = SDL_CreateWindow(
     "Chip8Emu", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 
-    ((config_parameters.window_width + config_parameters.side_border + config_parameters.side_border) * config_parameters.scale_factor), 
-    ((config_parameters.window_height + config_parameters.top_border + config_parameters.side_border) * config_parameters.scale_factor), 0);
+    ((cfg->window_width + cfg->side_border + cfg->side_border) * cfg->scale_factor), 
+    ((cfg->window_height + cfg->top_border + cfg->side_border) * cfg->scale_factor),
+    cfg->hidden_window ? SDL_WINDOW_HIDDEN : 0);
 
   // Try to create SDL Window
   if (sdl_parameters->main_window == NULL)
@@ -74,12 +722,41 @@ bool init_sdl(sdl_params_t* sdl_parameters, user_config_params_t config_paramete
     return false;
   }
 
+  // The title font is loaded once here, update_window only draws with it
+  sdl_parameters->title_font = TTF_OpenFont("Poxast-R9.ttf", 40);
+  if (sdl_parameters->title_font == NULL)
+    SDL_Log("Error loading font, drawing without the title: %s\n", TTF_GetError());
+
+  // Filtered modes draw through the CPU scaler and a streaming texture
+  if (cfg->render_filter != RENDER_RECTS && !init_render_filter(sdl_parameters, cfg))
+    return false;
+
   return true;
 }
 
 
-// Initialize an instance of a chip8
-bool init_chip8(chip8_t* c8, const char rom_name[])
+// Destroy the window, renderer, font and render filter created by init_sdl / create_sdl_window
+void close_sdl(sdl_params_t* sdl_parameters)
+{
+  free_render_filter(sdl_parameters);
+
+  if (sdl_parameters->title_font != NULL)
+    TTF_CloseFont(sdl_parameters->title_font);
+
+  if (sdl_parameters->main_renderer != NULL)
+    SDL_DestroyRenderer(sdl_parameters->main_renderer);
+
+  if (sdl_parameters->main_window != NULL)
+    SDL_DestroyWindow(sdl_parameters->main_window);
+
+  sdl_parameters->title_font = NULL;
+  sdl_parameters->main_renderer = NULL;
+  sdl_parameters->main_window = NULL;
+}
+
+
+// Initialize an instance of a chip8 running a mapped ROM
+bool init_chip8(chip8_t* c8, rom_file_t* rom)
 {
   // Programs are generally loaded at RAM location 0x200
   const uint16_t program_entry_point = 0x200;
@@ -115,40 +792,25 @@ bool init_chip8(chip8_t* c8, const char rom_name[])
   // Load font set (digits 0-9 and letters A-F)
   memcpy(&c8->emu_ram[0], &system_font, sizeof(system_font));
 
-  // Read ROM Data
-  FILE* rom_data = fopen(rom_name, "rb");
-  if (!rom_data)
-  {
-    SDL_Log("chip8 ROM file %s cannot be read", rom_name);
-    return false;
-  }
-
-  // Get ROM size
-  fseek(rom_data, 0, SEEK_END);             // Move filePtr to end of file
-  const size_t rom_size = ftell(rom_data);  // Get current filePtr
+  // ROM was mapped (and hashed) by map_rom_file, just copy it in
   const size_t max_rom_size = sizeof(c8->emu_ram) - program_entry_point;
-  rewind(rom_data);
 
-  if (rom_size > max_rom_size)
+  if (rom->size > max_rom_size)
   {
-    SDL_Log("ROM file size %u ... max allowed size %u.", (unsigned int)rom_size, (unsigned int)max_rom_size);
+    SDL_Log("ROM file size %u ... max allowed size %u.", (unsigned int)rom->size, (unsigned int)max_rom_size);
     return false;
   }
 
   // Load ROM data
-  if (fread(&c8->emu_ram[program_entry_point], rom_size, 1, rom_data) != 1)
-  {
-    SDL_Log("Error when reading ROM file into chip8 RAM");
-    return false;
-  }
-
-  fclose(rom_data);
+  if (rom->size > 0)
+    memcpy(&c8->emu_ram[program_entry_point], rom->data, rom->size);
 
   // Set C8 defaults
   c8->emu_state = RUNNING;
   c8->emu_pc = program_entry_point;
-  c8->emu_romName = rom_name;
+  c8->emu_romName = rom->path;
   c8->emu_subrStack_ptr = &c8->emu_subrStack[0];
+  c8->emu_rng_state = chip8_random_seed(0);
 
   return true;
 }
@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chip8Emu.h"
+
+
+
+// Index file layout (byte offsets, all little endian)
+// Header:  magic[8] 0, version 8, num_profiles 12
+// Profile: rom_hash 0, platform 8, quirks 12, IPS 16, fg 20, bg 24, keymap[16] 28, title[48] 92, scale 140, filter 141, reserved 142-143
+#define LIBRARY_HEADER_VERSION        8
+#define LIBRARY_HEADER_NUM_PROFILES   12
+
+#define PROFILE_ROM_HASH              0
+#define PROFILE_PLATFORM              8
+#define PROFILE_QUIRKS                12
+#define PROFILE_IPS                   16
+#define PROFILE_FG_COLOR              20
+#define PROFILE_BG_COLOR              24
+#define PROFILE_KEYMAP                28
+#define PROFILE_TITLE                 92
+#define PROFILE_SCALE                 140
+#define PROFILE_FILTER                141
+
+_Static_assert(PROFILE_TITLE == PROFILE_KEYMAP + 16 * 4 && PROFILE_SCALE == PROFILE_TITLE + sizeof(((rom_profile_t*)0)->title),
+               "library profile fields must not overlap");
+
+
+// Indexed by rom_platform_t
+static const char* const platform_names[] = {"default", "vip", "chip48", "schip"};
+
+
+// Default quirk set of a platform
+uint32_t platform_default_quirks(rom_platform_t platform)
+{
+  switch (platform)
+  {
+    case PLATFORM_COSMAC_VIP:   return QUIRK_VF_RESET | QUIRK_SHIFT_USES_VY | QUIRK_MEMORY_INCREMENT;
+    case PLATFORM_CHIP48:       return QUIRK_JUMP_VX;
+    case PLATFORM_SCHIP:        return QUIRK_JUMP_VX;
+    default:                    return 0;
+  }
+}
+
+
+// Short name of a platform as used by --platform
+const char* platform_name(rom_platform_t platform)
+{
+  return (platform < sizeof(platform_names) / sizeof(platform_names[0])) ? platform_names[platform] : "unknown";
+}
+
+
+// Little endian readers and writers for the index file
+static uint32_t library_get_u32(const uint8_t* bytes)
+{
+  return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+
+static uint64_t library_get_u64(const uint8_t* bytes)
+{
+  return (uint64_t)library_get_u32(bytes) | ((uint64_t)library_get_u32(bytes + 4) << 32);
+}
+
+
+static void library_put_u32(uint8_t* bytes, uint32_t value)
+{
+  for (uint8_t i=0; i<4; i++)
+    bytes[i] = (value >> (8 * i)) & 0xFF;
+}
+
+
+static void library_put_u64(uint8_t* bytes, uint64_t value)
+{
+  library_put_u32(bytes, value & 0xFFFFFFFF);
+  library_put_u32(bytes + 4, value >> 32);
+}
+
+
+// Profile record -> profile
+static void decode_rom_profile(const uint8_t* record, rom_profile_t* profile)
+{
+  profile->rom_hash = library_get_u64(record + PROFILE_ROM_HASH);
+  profile->platform = library_get_u32(record + PROFILE_PLATFORM);
+  profile->quirks = library_get_u32(record + PROFILE_QUIRKS);
+  profile->instructions_per_second = library_get_u32(record + PROFILE_IPS);
+  profile->fg_color = library_get_u32(record + PROFILE_FG_COLOR);
+  profile->bg_color = library_get_u32(record + PROFILE_BG_COLOR);
+
+  for (uint8_t i=0; i<16; i++)
+    profile->keymap[i] = (int32_t)library_get_u32(record + PROFILE_KEYMAP + 4 * i);
+
+  memcpy(profile->title, record + PROFILE_TITLE, sizeof(profile->title));
+  profile->scale_factor = record[PROFILE_SCALE];
+  profile->render_filter = record[PROFILE_FILTER];
+}
+
+
+// Profile -> profile record (reserved bytes zeroed)
+static void encode_rom_profile(const rom_profile_t* profile, uint8_t* record)
+{
+  memset(record, 0, ROM_LIBRARY_PROFILE_SIZE);
+
+  library_put_u64(record + PROFILE_ROM_HASH, profile->rom_hash);
+  library_put_u32(record + PROFILE_PLATFORM, profile->platform);
+  library_put_u32(record + PROFILE_QUIRKS, profile->quirks);
+  library_put_u32(record + PROFILE_IPS, profile->instructions_per_second);
+  library_put_u32(record + PROFILE_FG_COLOR, profile->fg_color);
+  library_put_u32(record + PROFILE_BG_COLOR, profile->bg_color);
+
+  for (uint8_t i=0; i<16; i++)
+    library_put_u32(record + PROFILE_KEYMAP + 4 * i, (uint32_t)profile->keymap[i]);
+
+  memcpy(record + PROFILE_TITLE, profile->title, sizeof(profile->title));
+  record[PROFILE_SCALE] = profile->scale_factor;
+  record[PROFILE_FILTER] = profile->render_filter;
+}
+
+
+// Hash of the profile record at index (the binary search key)
+static inline uint64_t library_profile_hash(const rom_library_t* library, uint32_t index)
+{
+  return library_get_u64(library->profiles + (size_t)index * ROM_LIBRARY_PROFILE_SIZE + PROFILE_ROM_HASH);
+}
+
+
+// 64 bit FNV-1a of the ROM contents (part of the index format, do not change)
+static uint64_t hash_rom_data(const uint8_t* data, size_t size)
+{
+  uint64_t hash = 0xCBF29CE484222325ull;
+
+  for (size_t i=0; i<size; i++)
+  {
+    hash ^= data[i];
+    hash *= 0x100000001B3ull;
+  }
+
+  return hash;
+}
+
+
+// Map a ROM file read-only and hash its contents (return true if mapped)
+bool map_rom_file(rom_file_t* rom, const char* path)
+{
+  memset(rom, 0, sizeof(*rom));
+  rom->path = path;
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    SDL_Log("chip8 ROM file %s cannot be read", path);
+    return false;
+  }
+
+  struct stat rom_stat;
+  if (fstat(fd, &rom_stat) != 0)
+  {
+    SDL_Log("chip8 ROM file %s cannot be read", path);
+    close(fd);
+    return false;
+  }
+
+  rom->size = rom_stat.st_size;
+
+  // Empty files cannot be mapped, they are just an empty ROM
+  if (rom->size > 0)
+  {
+    void* map = mmap(NULL, rom->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      SDL_Log("Could not map chip8 ROM file %s", path);
+      close(fd);
+      return false;
+    }
+    rom->data = map;
+  }
+
+  close(fd);
+
+  rom->hash = hash_rom_data(rom->data, rom->size);
+  return true;
+}
+
+
+// Unmap a ROM mapped by map_rom_file
+void unmap_rom_file(rom_file_t* rom)
+{
+  if (rom->data != NULL)
+    munmap((void*)rom->data, rom->size);
+
+  rom->data = NULL;
+  rom->size = 0;
+}
+
+
+// Map a library index file (return false if it is missing or not a valid index)
+bool open_rom_library(rom_library_t* library, const char* path)
+{
+  memset(library, 0, sizeof(*library));
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat library_stat;
+  if (fstat(fd, &library_stat) != 0 || (size_t)library_stat.st_size < ROM_LIBRARY_HEADER_SIZE)
+  {
+    close(fd);
+    return false;
+  }
+
+  library->map_size = library_stat.st_size;
+  library->map = mmap(NULL, library->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (library->map == MAP_FAILED)
+  {
+    library->map = NULL;
+    return false;
+  }
+
+  const uint8_t* header = library->map;
+  library->num_profiles = library_get_u32(header + LIBRARY_HEADER_NUM_PROFILES);
+  library->profiles = header + ROM_LIBRARY_HEADER_SIZE;
+
+  const size_t expected_size = ROM_LIBRARY_HEADER_SIZE + (size_t)library->num_profiles * ROM_LIBRARY_PROFILE_SIZE;
+  if (memcmp(header, ROM_LIBRARY_MAGIC, 8) != 0 || library_get_u32(header + LIBRARY_HEADER_VERSION) != ROM_LIBRARY_VERSION ||
+      library->map_size < expected_size)
+  {
+    SDL_Log("%s is not a valid ROM library index, ignoring it", path);
+    close_rom_library(library);
+    return false;
+  }
+
+  return true;
+}
+
+
+// Binary search the library for a ROM hash and decode its profile (false if there is none)
+bool find_rom_profile(rom_library_t* library, uint64_t rom_hash, rom_profile_t* profile)
+{
+  if (library->map == NULL)
+    return false;
+
+  uint32_t low = 0;
+  uint32_t high = library->num_profiles;
+
+  while (low < high)
+  {
+    const uint32_t mid = low + (high - low) / 2;
+
+    if (library_profile_hash(library, mid) < rom_hash)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  if (low >= library->num_profiles || library_profile_hash(library, low) != rom_hash)
+    return false;
+
+  decode_rom_profile(library->profiles + (size_t)low * ROM_LIBRARY_PROFILE_SIZE, profile);
+  return true;
+}
+
+
+// Unmap a library opened by open_rom_library
+void close_rom_library(rom_library_t* library)
+{
+  if (library->map != NULL)
+    munmap(library->map, library->map_size);
+
+  memset(library, 0, sizeof(*library));
+}
+
+
+// Apply the library profile for this ROM, if any, to every setting not given on the command line
+void apply_rom_profile(user_config_params_t* cfg, rom_file_t* rom)
+{
+  rom_library_t library;
+  if (cfg->library_path == NULL || !open_rom_library(&library, cfg->library_path))
+    return;
+
+  rom_profile_t profile;
+  if (find_rom_profile(&library, rom->hash, &profile))
+  {
+    if (!(cfg->cli_set & CFG_SET_PLATFORM))
+      cfg->platform = profile.platform;
+
+    if (!(cfg->cli_set & CFG_SET_QUIRKS))
+      cfg->quirks = profile.quirks;
+
+    if (!(cfg->cli_set & CFG_SET_IPS) && profile.instructions_per_second != 0)
+      cfg->instructions_per_second = profile.instructions_per_second;
+
+    if (!(cfg->cli_set & CFG_SET_COLORS))
+    {
+      cfg->fg_color = profile.fg_color;
+      cfg->bg_color = profile.bg_color;
+    }
+
+    if (!(cfg->cli_set & CFG_SET_KEYMAP))
+    {
+      for (uint8_t i=0; i<16; i++)
+        cfg->keymap[i] = profile.keymap[i];
+    }
+
+    // Profiles saved before render settings were stored have a zero scale
+    if (!(cfg->cli_set & CFG_SET_SCALE) && profile.scale_factor != 0)
+      cfg->scale_factor = profile.scale_factor;
+
+    if (!(cfg->cli_set & CFG_SET_FILTER) && profile.scale_factor != 0 && profile.render_filter <= RENDER_SCALE2X)
+    {
+      cfg->render_filter = profile.render_filter;
+
+      // Phosphor glow still needs the CPU scaler
+      if (cfg->phosphor_decay != 0 && cfg->render_filter == RENDER_RECTS)
+        cfg->render_filter = RENDER_NEAREST;
+    }
+
+    SDL_Log("Library: %.*s (%s, quirks 0x%02X, %u IPS, scale %u, %s)", (int)sizeof(profile.title), profile.title,
+            platform_name(cfg->platform), (unsigned int)cfg->quirks, (unsigned int)cfg->instructions_per_second,
+            (unsigned int)cfg->scale_factor, render_filter_name(cfg->render_filter));
+  }
+
+  close_rom_library(&library);
+}
+
+
+// Store the current settings as this ROM's profile (return true if the index was written)
+bool save_rom_profile(user_config_params_t* cfg, rom_file_t* rom)
+{
+  rom_profile_t new_profile = {0};
+  new_profile.rom_hash = rom->hash;
+  new_profile.platform = cfg->platform;
+  new_profile.quirks = cfg->quirks;
+  new_profile.instructions_per_second = cfg->instructions_per_second;
+  new_profile.fg_color = cfg->fg_color;
+  new_profile.bg_color = cfg->bg_color;
+  new_profile.scale_factor = (cfg->scale_factor > 255) ? 255 : cfg->scale_factor;
+  new_profile.render_filter = cfg->render_filter;
+
+  for (uint8_t i=0; i<16; i++)
+    new_profile.keymap[i] = cfg->keymap[i];
+
+  // Title defaults to the ROM file name without its directory
+  const char* title = cfg->library_title;
+  if (title == NULL)
+  {
+    title = strrchr(rom->path, '/');
+    title = (title != NULL) ? title + 1 : rom->path;
+  }
+  strncpy(new_profile.title, title, sizeof(new_profile.title) - 1);
+
+  // Copy the old index around the new profile (replacing an existing one for this ROM) so it stays sorted
+  rom_library_t library;
+  const bool have_library = open_rom_library(&library, cfg->library_path);
+  const uint32_t old_profiles = have_library ? library.num_profiles : 0;
+
+  uint32_t insert_at = 0;
+  while (insert_at < old_profiles && library_profile_hash(&library, insert_at) < rom->hash)
+    insert_at++;
+
+  const bool replace = (insert_at < old_profiles && library_profile_hash(&library, insert_at) == rom->hash);
+
+  uint8_t header[ROM_LIBRARY_HEADER_SIZE] = {0};
+  memcpy(header, ROM_LIBRARY_MAGIC, 8);
+  library_put_u32(header + LIBRARY_HEADER_VERSION, ROM_LIBRARY_VERSION);
+  library_put_u32(header + LIBRARY_HEADER_NUM_PROFILES, old_profiles + (replace ? 0 : 1));
+
+  uint8_t new_record[ROM_LIBRARY_PROFILE_SIZE];
+  encode_rom_profile(&new_profile, new_record);
+
+  // Write a new file and rename it over the old one, so a running emulator never maps a half written index
+  char temp_path[4096];
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", cfg->library_path);
+
+  FILE* library_file = fopen(temp_path, "wb");
+  if (library_file == NULL)
+  {
+    SDL_Log("Could not write ROM library %s", temp_path);
+    if (have_library)
+      close_rom_library(&library);
+    return false;
+  }
+
+  // Old records are copied as they are, they are already in the file format
+  bool written = fwrite(header, sizeof(header), 1, library_file) == 1;
+  if (insert_at > 0)
+    written &= fwrite(library.profiles, ROM_LIBRARY_PROFILE_SIZE, insert_at, library_file) == insert_at;
+
+  written &= fwrite(new_record, sizeof(new_record), 1, library_file) == 1;
+
+  const uint32_t rest = insert_at + (replace ? 1 : 0);
+  if (rest < old_profiles)
+    written &= fwrite(library.profiles + (size_t)rest * ROM_LIBRARY_PROFILE_SIZE, ROM_LIBRARY_PROFILE_SIZE, old_profiles - rest, library_file) == old_profiles - rest;
+
+  written &= (fclose(library_file) == 0);
+
+  if (have_library)
+    close_rom_library(&library);
+
+  if (!written || rename(temp_path, cfg->library_path) != 0)
+  {
+    SDL_Log("Could not write ROM library %s", cfg->library_path);
+    remove(temp_path);
+    return false;
+  }
+
+  SDL_Log("Library: saved profile for %s (%016llx) to %s", new_profile.title, (unsigned long long)rom->hash, cfg->library_path);
+  return true;
+}
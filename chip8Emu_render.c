@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "chip8Emu.h"
+
+// Pixel kernels work on rows of 8 bit brightness values (0 = background, 255 = foreground)
+// Widest vector the compiler was told it may use (build with -mavx2 for AVX2, which also enables the gathers)
+// CHIP8_SCALAR_RENDER forces the portable kernels, tests/run_render_check.sh checks every SIMD build draws the same frames as them
+#if defined(__AVX2__) && !defined(CHIP8_SCALAR_RENDER)
+  #include <immintrin.h>
+  typedef __m256i pix_vec_t;
+  #define PIX_VEC_WIDTH 32
+
+  static inline pix_vec_t pix_load(const uint8_t* p)              { return _mm256_loadu_si256((const __m256i*)p); }
+  static inline void pix_store(uint8_t* p, pix_vec_t v)           { _mm256_storeu_si256((__m256i*)p, v); }
+  static inline pix_vec_t pix_zero(void)                          { return _mm256_setzero_si256(); }
+  static inline pix_vec_t pix_and(pix_vec_t a, pix_vec_t b)       { return _mm256_and_si256(a, b); }
+  static inline pix_vec_t pix_andnot(pix_vec_t a, pix_vec_t b)    { return _mm256_andnot_si256(a, b); }
+  static inline pix_vec_t pix_max(pix_vec_t a, pix_vec_t b)       { return _mm256_max_epu8(a, b); }
+  static inline pix_vec_t pix_cmpeq(pix_vec_t a, pix_vec_t b)     { return _mm256_cmpeq_epi8(a, b); }
+  static inline pix_vec_t pix_blend(pix_vec_t a, pix_vec_t b, pix_vec_t m) { return _mm256_blendv_epi8(a, b, m); }
+
+  // (a * scale) >> 8 per byte
+  static inline pix_vec_t pix_scale(pix_vec_t a, uint8_t scale)
+  {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i factor = _mm256_set1_epi16(scale);
+    const __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), factor), 8);
+    const __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), factor), 8);
+    return _mm256_packus_epi16(lo, hi);
+  }
+
+  // a0 b0 a1 b1 ... (unpack works per 128 bit half, so put the halves back in order)
+  static inline void pix_interleave(pix_vec_t a, pix_vec_t b, pix_vec_t* lo, pix_vec_t* hi)
+  {
+    const __m256i l = _mm256_unpacklo_epi8(a, b);
+    const __m256i h = _mm256_unpackhi_epi8(a, b);
+    *lo = _mm256_permute2x128_si256(l, h, 0x20);
+    *hi = _mm256_permute2x128_si256(l, h, 0x31);
+  }
+
+#elif defined(__SSE2__) && !defined(CHIP8_SCALAR_RENDER)
+  #include <emmintrin.h>
+  typedef __m128i pix_vec_t;
+  #define PIX_VEC_WIDTH 16
+
+  static inline pix_vec_t pix_load(const uint8_t* p)              { return _mm_loadu_si128((const __m128i*)p); }
+  static inline void pix_store(uint8_t* p, pix_vec_t v)           { _mm_storeu_si128((__m128i*)p, v); }
+  static inline pix_vec_t pix_zero(void)                          { return _mm_setzero_si128(); }
+  static inline pix_vec_t pix_and(pix_vec_t a, pix_vec_t b)       { return _mm_and_si128(a, b); }
+  static inline pix_vec_t pix_andnot(pix_vec_t a, pix_vec_t b)    { return _mm_andnot_si128(a, b); }
+  static inline pix_vec_t pix_max(pix_vec_t a, pix_vec_t b)       { return _mm_max_epu8(a, b); }
+  static inline pix_vec_t pix_cmpeq(pix_vec_t a, pix_vec_t b)     { return _mm_cmpeq_epi8(a, b); }
+  static inline pix_vec_t pix_blend(pix_vec_t a, pix_vec_t b, pix_vec_t m) { return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a)); }
+
+  static inline pix_vec_t pix_scale(pix_vec_t a, uint8_t scale)
+  {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i factor = _mm_set1_epi16(scale);
+    const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), factor), 8);
+    const __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), factor), 8);
+    return _mm_packus_epi16(lo, hi);
+  }
+
+  static inline void pix_interleave(pix_vec_t a, pix_vec_t b, pix_vec_t* lo, pix_vec_t* hi)
+  {
+    *lo = _mm_unpacklo_epi8(a, b);
+    *hi = _mm_unpackhi_epi8(a, b);
+  }
+
+#else
+  // Portable fallback: one pixel at a time, same kernels
+  typedef uint8_t pix_vec_t;
+  #define PIX_VEC_WIDTH 1
+
+  static inline pix_vec_t pix_load(const uint8_t* p)              { return *p; }
+  static inline void pix_store(uint8_t* p, pix_vec_t v)           { *p = v; }
+  static inline pix_vec_t pix_zero(void)                          { return 0; }
+  static inline pix_vec_t pix_and(pix_vec_t a, pix_vec_t b)       { return a & b; }
+  static inline pix_vec_t pix_andnot(pix_vec_t a, pix_vec_t b)    { return ~a & b; }
+  static inline pix_vec_t pix_max(pix_vec_t a, pix_vec_t b)       { return (a > b) ? a : b; }
+  static inline pix_vec_t pix_cmpeq(pix_vec_t a, pix_vec_t b)     { return (a == b) ? 0xFF : 0x00; }
+  static inline pix_vec_t pix_blend(pix_vec_t a, pix_vec_t b, pix_vec_t m) { return (b & m) | (a & ~m); }
+  static inline pix_vec_t pix_scale(pix_vec_t a, uint8_t scale)   { return (uint8_t)((a * scale) >> 8); }
+
+  static inline void pix_interleave(pix_vec_t a, pix_vec_t b, pix_vec_t* lo, pix_vec_t* hi)
+  {
+    *lo = a;
+    *hi = b;
+  }
+#endif
+
+
+
+// New brightness of every display pixel: lit pixels are 255, unlit ones keep decay/256 of last frame's glow (0 = no glow)
+static void render_update_intensity(render_params_t* render, const bool* display, uint8_t decay)
+{
+  const uint32_t width = render->display_width;
+  const uint32_t height = render->display_height;
+  const uint32_t stride = render->intensity_stride;
+
+  for (uint32_t y=0; y<height; y++)
+  {
+    const uint8_t* display_row = (const uint8_t*)&display[y * width];
+    uint8_t* row = &render->intensity[y * stride];
+    uint32_t x = 0;
+
+    // Display bools are 0/1 bytes, so != 0 turns them into an 0x00/0xFF mask
+    for (; x + PIX_VEC_WIDTH <= width; x += PIX_VEC_WIDTH)
+    {
+      const pix_vec_t lit = pix_andnot(pix_cmpeq(pix_load(&display_row[x]), pix_zero()), pix_cmpeq(pix_zero(), pix_zero()));
+      pix_store(&row[x], decay ? pix_max(lit, pix_scale(pix_load(&row[x]), decay)) : lit);
+    }
+
+    for (; x<width; x++)
+    {
+      const uint8_t glow = (uint8_t)((row[x] * decay) >> 8);
+      row[x] = display_row[x] ? 0xFF : glow;
+    }
+
+    // Clamp the edges into the border so Scale2x neighbours never read outside the image
+    row[-1] = row[0];
+    row[width] = row[width - 1];
+  }
+
+  memcpy(&render->intensity[-(int32_t)stride - 1], &render->intensity[-1], stride);
+  memcpy(&render->intensity[height * stride - 1], &render->intensity[(height - 1) * stride - 1], stride);
+}
+
+
+// Scale2x/EPX: every pixel becomes 2x2, corners take a neighbour's value where two edges meet diagonally
+static void render_scale2x(render_params_t* render)
+{
+  const uint32_t width = render->display_width;
+  const uint32_t height = render->display_height;
+  const uint32_t stride = render->intensity_stride;
+  const uint32_t out_stride = width * 2;
+
+  for (uint32_t y=0; y<height; y++)
+  {
+    const uint8_t* row = &render->intensity[y * stride];
+    const uint8_t* row_above = row - stride;
+    const uint8_t* row_below = row + stride;
+    const uint8_t* row_left = row - 1;
+    const uint8_t* row_right = row + 1;
+    uint8_t* out_top = &render->scaled[(2 * y) * out_stride];
+    uint8_t* out_bottom = &render->scaled[(2 * y + 1) * out_stride];
+    uint32_t x = 0;
+
+    //   B
+    // D E F
+    //   H
+    for (; x + PIX_VEC_WIDTH <= width; x += PIX_VEC_WIDTH)
+    {
+      const pix_vec_t b = pix_load(&row_above[x]);
+      const pix_vec_t d = pix_load(&row_left[x]);
+      const pix_vec_t e = pix_load(&row[x]);
+      const pix_vec_t f = pix_load(&row_right[x]);
+      const pix_vec_t h = pix_load(&row_below[x]);
+
+      // Only where B != H and D != F
+      const pix_vec_t active = pix_andnot(pix_max(pix_cmpeq(b, h), pix_cmpeq(d, f)), pix_cmpeq(pix_zero(), pix_zero()));
+
+      const pix_vec_t e0 = pix_blend(e, d, pix_and(active, pix_cmpeq(d, b)));
+      const pix_vec_t e1 = pix_blend(e, f, pix_and(active, pix_cmpeq(b, f)));
+      const pix_vec_t e2 = pix_blend(e, d, pix_and(active, pix_cmpeq(d, h)));
+      const pix_vec_t e3 = pix_blend(e, f, pix_and(active, pix_cmpeq(h, f)));
+
+      pix_vec_t lo, hi;
+      pix_interleave(e0, e1, &lo, &hi);
+      pix_store(&out_top[2 * x], lo);
+      pix_store(&out_top[2 * x + PIX_VEC_WIDTH], hi);
+
+      pix_interleave(e2, e3, &lo, &hi);
+      pix_store(&out_bottom[2 * x], lo);
+      pix_store(&out_bottom[2 * x + PIX_VEC_WIDTH], hi);
+    }
+
+    for (; x<width; x++)
+    {
+      const uint8_t b = row_above[x], d = row_left[x], e = row[x], f = row_right[x], h = row_below[x];
+      const bool active = (b != h) && (d != f);
+
+      out_top[2 * x]        = (active && d == b) ? d : e;
+      out_top[2 * x + 1]    = (active && b == f) ? f : e;
+      out_bottom[2 * x]     = (active && d == h) ? d : e;
+      out_bottom[2 * x + 1] = (active && h == f) ? f : e;
+    }
+  }
+}
+
+
+// Nearest neighbour expand of a brightness image to the output, through the palette
+// Only one output row per source row is computed, the rest are copies of it
+static void render_expand_nearest(render_params_t* render, const uint8_t* source, uint32_t source_stride, uint32_t source_height,
+                                  uint8_t* pixels, int pitch)
+{
+  const uint32_t out_width = render->out_width;
+  const uint32_t out_height = render->out_height;
+  int64_t prev_source_y = -1;
+
+  for (uint32_t y=0; y<out_height; y++)
+  {
+    const uint32_t source_y = (uint64_t)y * source_height / out_height;
+    uint32_t* out_row = (uint32_t*)&pixels[(size_t)y * pitch];
+
+    if (source_y == prev_source_y)
+    {
+      memcpy(out_row, &pixels[(size_t)(y - 1) * pitch], out_width * sizeof(uint32_t));
+      continue;
+    }
+
+    const uint8_t* source_row = &source[source_y * source_stride];
+    uint32_t x = 0;
+
+#if defined(__AVX2__) && !defined(CHIP8_SCALAR_RENDER)
+    // Gather the brightness bytes through the column table, then gather their colors from the palette
+    // (reads up to 3 bytes past a pixel, which is why every source buffer has slack after it)
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    for (; x + 8 <= out_width; x += 8)
+    {
+      const __m256i column = _mm256_loadu_si256((const __m256i*)&render->x_index[x]);
+      const __m256i value = _mm256_and_si256(_mm256_i32gather_epi32((const int*)source_row, column, 1), byte_mask);
+      _mm256_storeu_si256((__m256i*)&out_row[x], _mm256_i32gather_epi32((const int*)render->palette, value, 4));
+    }
+#endif
+
+    for (; x<out_width; x++)
+      out_row[x] = render->palette[source_row[render->x_index[x]]];
+
+    prev_source_y = source_y;
+  }
+}
+
+
+// Free a scaler allocated by alloc_render_params (NULL is fine)
+static void free_render_params(render_params_t* render)
+{
+  if (render == NULL)
+    return;
+
+  free(render->intensity_buffer);
+  free(render->scaled);
+  free(render->x_index);
+  free(render);
+}
+
+
+// Allocate the scaler buffers and build its tables (NULL if out of memory)
+static render_params_t* alloc_render_params(user_config_params_t* cfg)
+{
+  render_params_t* render = calloc(1, sizeof(render_params_t));
+  if (render == NULL)
+    return NULL;
+
+  render->display_width = cfg->window_width;
+  render->display_height = cfg->window_height;
+  render->out_width = cfg->window_width * cfg->scale_factor;
+  render->out_height = cfg->window_height * cfg->scale_factor;
+
+  // One border pixel around the brightness image, plus slack after every buffer for the 4 byte gathers
+  render->intensity_stride = render->display_width + 2;
+  render->intensity_buffer = calloc((size_t)render->intensity_stride * (render->display_height + 2) + 4, 1);
+  render->intensity = &render->intensity_buffer[render->intensity_stride + 1];
+  render->scaled = calloc((size_t)render->display_width * 2 * render->display_height * 2 + 4, 1);
+  render->x_index = malloc(render->out_width * sizeof(int32_t));
+
+  if (render->intensity_buffer == NULL || render->scaled == NULL || render->x_index == NULL)
+  {
+    free_render_params(render);
+    return NULL;
+  }
+
+  // Output column -> source column of the image being expanded (doubled by Scale2x)
+  const uint32_t source_width = (cfg->render_filter == RENDER_SCALE2X) ? render->display_width * 2 : render->display_width;
+  for (uint32_t x=0; x<render->out_width; x++)
+    render->x_index[x] = (uint64_t)x * source_width / render->out_width;
+
+  // Brightness -> color between bg and fg (colors are 0xRRGGBBAA, the same layout as SDL_PIXELFORMAT_RGBA8888)
+  for (uint32_t i=0; i<256; i++)
+  {
+    uint32_t color = 0;
+    for (uint32_t shift=0; shift<32; shift+=8)
+    {
+      const int32_t bg = (cfg->bg_color >> shift) & 0xFF;
+      const int32_t fg = (cfg->fg_color >> shift) & 0xFF;
+      color |= (uint32_t)(bg + (fg - bg) * (int32_t)i / 255) << shift;
+    }
+    render->palette[i] = color;
+  }
+
+  return render;
+}
+
+
+// Allocate the scaler buffers and the streaming texture the filtered frame goes into (return true if initialized)
+bool init_render_filter(sdl_params_t* sdl_params, user_config_params_t* cfg)
+{
+  sdl_params->render = alloc_render_params(cfg);
+  if (sdl_params->render == NULL)
+  {
+    SDL_Log("Could not allocate render filter buffers ... exiting!");
+    return false;
+  }
+
+  const render_params_t* render = sdl_params->render;
+  sdl_params->frame_texture = SDL_CreateTexture(sdl_params->main_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                                render->out_width, render->out_height);
+  if (sdl_params->frame_texture == NULL)
+  {
+    SDL_Log("Could not create frame texture ... exiting! %s", SDL_GetError());
+    free_render_filter(sdl_params);
+    return false;
+  }
+
+  return true;
+}
+
+
+// Filter the display into the frame texture and copy it to the window (one texture upload per frame)
+void render_filtered_frame(sdl_params_t* sdl_params, user_config_params_t* cfg, chip8_t* c8)
+{
+  render_params_t* render = sdl_params->render;
+
+  render_update_intensity(render, c8->emu_display, cfg->phosphor_decay);
+
+  const uint8_t* source = render->intensity;
+  uint32_t source_stride = render->intensity_stride;
+  uint32_t source_height = render->display_height;
+
+  if (cfg->render_filter == RENDER_SCALE2X)
+  {
+    render_scale2x(render);
+    source = render->scaled;
+    source_stride = render->display_width * 2;
+    source_height = render->display_height * 2;
+  }
+
+  // Write straight into the texture's memory instead of building the frame elsewhere and copying it in
+  void* pixels = NULL;
+  int pitch = 0;
+  if (SDL_LockTexture(sdl_params->frame_texture, NULL, &pixels, &pitch) != 0)
+    return;
+
+  render_expand_nearest(render, source, source_stride, source_height, pixels, pitch);
+  SDL_UnlockTexture(sdl_params->frame_texture);
+
+  const SDL_Rect display_rect =
+  {
+    .x = cfg->side_border * cfg->scale_factor,
+    .y = cfg->top_border * cfg->scale_factor,
+    .w = render->out_width,
+    .h = render->out_height
+  };
+  SDL_RenderCopy(sdl_params->main_renderer, sdl_params->frame_texture, NULL, &display_rect);
+}
+
+
+// Free everything allocated by init_render_filter
+void free_render_filter(sdl_params_t* sdl_params)
+{
+  if (sdl_params->frame_texture != NULL)
+    SDL_DestroyTexture(sdl_params->frame_texture);
+
+  free_render_params(sdl_params->render);
+
+  sdl_params->frame_texture = NULL;
+  sdl_params->render = NULL;
+}
+
+
+// Short name of a filter as used by --filter
+const char* render_filter_name(render_filter_t filter)
+{
+  static const char* const filter_names[] = {"rects", "nearest", "scale2x"};
+
+  return (filter < sizeof(filter_names) / sizeof(filter_names[0])) ? filter_names[filter] : "unknown";
+}
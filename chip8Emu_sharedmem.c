@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "chip8Emu.h"
+
+
+
+_Static_assert(sizeof(((chip8_shm_t*)0)->display) == sizeof(((chip8_t*)0)->emu_display), "shared frame must match the chip8 display");
+
+
+// How long lockstep waits for a frame request before going back to the SDL event loop
+#define SHM_LOCKSTEP_WAIT_MS 50
+
+
+// Sleep until *addr no longer holds expected (or timeout), falls back to a short sleep without futexes
+static void shm_futex_wait(_Atomic uint32_t* addr, uint32_t expected, uint32_t timeout_ms)
+{
+#ifdef __linux__
+  struct timespec timeout = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+  syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT, expected, &timeout, NULL, 0);
+#else
+  if (atomic_load_explicit(addr, memory_order_acquire) == expected)
+    SDL_Delay(1);
+#endif
+}
+
+
+// Wake every process sleeping on addr
+static void shm_futex_wake(_Atomic uint32_t* addr)
+{
+#ifdef __linux__
+  syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+  (void)addr;
+#endif
+}
+
+
+// Create and map the shared memory segment (return true if initialized)
+bool init_shared_memory(shm_params_t* shm_params, user_config_params_t* cfg)
+{
+  shm_params->shm_name = cfg->shm_name;
+  shm_params->shm_fd = shm_open(cfg->shm_name, O_CREAT | O_RDWR, 0600);
+  if (shm_params->shm_fd < 0)
+  {
+    SDL_Log("Could not open shared memory %s ... exiting!", cfg->shm_name);
+    return false;
+  }
+
+  if (ftruncate(shm_params->shm_fd, sizeof(chip8_shm_t)) != 0)
+  {
+    SDL_Log("Could not size shared memory %s ... exiting!", cfg->shm_name);
+    close(shm_params->shm_fd);
+    return false;
+  }
+
+  shm_params->shm = mmap(NULL, sizeof(chip8_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_params->shm_fd, 0);
+  if (shm_params->shm == MAP_FAILED)
+  {
+    SDL_Log("Could not map shared memory %s ... exiting!", cfg->shm_name);
+    shm_params->shm = NULL;
+    close(shm_params->shm_fd);
+    return false;
+  }
+
+  // Start from a clean segment in case a previous run left one behind
+  memset(shm_params->shm, 0, sizeof(chip8_shm_t));
+  shm_params->shm->version = CHIP8_SHM_VERSION;
+  shm_params->shm->display_width = CHIP8_DISPLAY_WIDTH;
+  shm_params->shm->display_height = CHIP8_DISPLAY_HEIGHT;
+  shm_params->prev_keypad_inject = 0;
+
+  // Magic goes last so consumers polling for it see a fully initialized segment
+  atomic_thread_fence(memory_order_release);
+  shm_params->shm->magic = CHIP8_SHM_MAGIC;
+
+  return true;
+}
+
+
+// Lockstep: wait (briefly) for a consumer to request the next frame, return true if one was requested (or quit was)
+bool shared_memory_await_frame(shm_params_t* shm_params)
+{
+  chip8_shm_t* shm = shm_params->shm;
+
+  // A consumer that only wants the emulator gone never requests another frame
+  if (shared_memory_quit_requested(shm_params))
+    return true;
+
+  uint32_t requested = atomic_load_explicit(&shm->frames_requested, memory_order_acquire);
+  if ((int32_t)(requested - shm->frame_count) > 0)
+    return true;
+
+  // Nothing requested yet, sleep until a consumer bumps frames_requested (or time out to keep SDL responsive and see quit)
+  shm_futex_wait(&shm->frames_requested, requested, SHM_LOCKSTEP_WAIT_MS);
+
+  requested = atomic_load_explicit(&shm->frames_requested, memory_order_acquire);
+  return (int32_t)(requested - shm->frame_count) > 0 || shared_memory_quit_requested(shm_params);
+}
+
+
+// True once an external process has set CHIP8_SHM_CTRL_QUIT
+bool shared_memory_quit_requested(shm_params_t* shm_params)
+{
+  return (atomic_load_explicit(&shm_params->shm->control, memory_order_acquire) & CHIP8_SHM_CTRL_QUIT) != 0;
+}
+
+
+// Apply keys and control flags written by external processes
+void shared_memory_apply_input(shm_params_t* shm_params, chip8_t* c8)
+{
+  chip8_shm_t* shm = shm_params->shm;
+
+  if (shared_memory_quit_requested(shm_params))
+  {
+    c8->emu_state = QUIT;
+    return;
+  }
+
+  // Only apply keys that changed, so injected keys and the real keyboard do not fight each other
+  uint16_t keypad_inject = atomic_load_explicit(&shm->keypad_inject, memory_order_acquire);
+  uint16_t changed_keys = keypad_inject ^ shm_params->prev_keypad_inject;
+
+  for (uint8_t i=0; changed_keys != 0; i++, changed_keys >>= 1)
+  {
+    if (changed_keys & 0x01)
+      c8->emu_keypad[i] = (keypad_inject >> i) & 0x01;
+  }
+
+  shm_params->prev_keypad_inject = keypad_inject;
+}
+
+
+// Publish the current frame and machine state to external processes
+void shared_memory_publish_frame(shm_params_t* shm_params, chip8_t* c8)
+{
+  chip8_shm_t* shm = shm_params->shm;
+  uint32_t seq = atomic_load_explicit(&shm->frame_seq, memory_order_relaxed);
+
+  // Odd sequence tells readers a frame is being written
+  atomic_store_explicit(&shm->frame_seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  shm->frame_count++;
+  shm->display_width = CHIP8_DISPLAY_WIDTH;
+  shm->display_height = CHIP8_DISPLAY_HEIGHT;
+  memcpy(shm->display, c8->emu_display, sizeof(shm->display));
+  memcpy(shm->keypad, c8->emu_keypad, sizeof(shm->keypad));
+  memcpy(shm->V, c8->emu_V, sizeof(shm->V));
+  shm->I = c8->emu_I;
+  shm->pc = c8->emu_pc;
+  shm->delay_timer = c8->emu_delayTimer;
+  shm->sound_timer = c8->emu_soundTimer;
+  shm->stack_depth = c8->emu_subrStack_ptr - &c8->emu_subrStack[0];
+  memcpy(shm->stack, c8->emu_subrStack, sizeof(shm->stack));
+
+  // Even sequence again, then wake anyone waiting for a new frame
+  atomic_store_explicit(&shm->frame_seq, seq + 2, memory_order_release);
+  shm_futex_wake(&shm->frame_seq);
+}
+
+
+// Unmap and remove the shared memory segment
+void close_shared_memory(shm_params_t* shm_params)
+{
+  if (shm_params->shm == NULL)
+    return;
+
+  // Let consumers blocked on the frame futex notice the emulator is gone
+  shm_params->shm->magic = 0;
+  atomic_fetch_add_explicit(&shm_params->shm->frame_seq, 2, memory_order_release);
+  shm_futex_wake(&shm_params->shm->frame_seq);
+
+  munmap(shm_params->shm, sizeof(chip8_shm_t));
+  close(shm_params->shm_fd);
+  shm_unlink(shm_params->shm_name);
+  shm_params->shm = NULL;
+}
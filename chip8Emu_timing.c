@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "chip8Emu.h"
+
+// COSMAC VIP timing model: every instruction is charged what the original interpreter spent on it in 1802 machine cycles
+// (8 clocks of the 1.76 MHz CPU), and a frame runs until its share of the 60Hz cycle budget is used up
+// Costs are the interpreter's fetch/decode plus the execution routine, data dependent ones are worked out from the operands
+
+// Fetch/decode of the VIP interpreter loop, paid by every instruction
+#define VIP_FETCH_CYCLES              40
+
+// DXYN: setup, then per sprite row either one byte (x on a byte boundary) or two bytes plus one shift per bit of misalignment
+#define VIP_DRAW_SETUP_CYCLES         26
+#define VIP_DRAW_ALIGNED_ROW_CYCLES   16
+#define VIP_DRAW_UNALIGNED_ROW_CYCLES 28
+#define VIP_DRAW_SHIFT_CYCLES         4
+
+// FX33 subtracts powers of ten one at a time, FX55/FX65 copy one register per loop
+#define VIP_BCD_SUBTRACT_CYCLES       16
+#define VIP_REGISTER_COPY_CYCLES      14
+
+// Execution cost by opcode nibble (D and F are all or partly operand dependent, see vip_variable_cycles)
+static const uint16_t vip_op_cycles[16] =
+{
+  24,   // 0: 00E0 / 00EE
+  12,   // 1: 1NNN
+  26,   // 2: 2NNN
+  10,   // 3: 3XNN
+  10,   // 4: 4XNN
+  14,   // 5: 5XY0
+  6,    // 6: 6XNN
+  10,   // 7: 7XNN
+  44,   // 8: 8XYN
+  14,   // 9: 9XY0
+  12,   // A: ANNN
+  22,   // B: BNNN
+  36,   // C: CXNN
+  VIP_DRAW_SETUP_CYCLES,
+  14,   // E: EX9E / EXA1
+  10    // F: FX07 / FX0A / FX15 / FX18 (others add to it)
+};
+
+// Opcode nibbles whose cost depends on the operands
+#define VIP_VARIABLE_COST_OPS ((1u << 0x0D) | (1u << 0x0F))
+
+
+
+// Operand dependent part of the DXYN and FXNN costs
+static uint32_t vip_variable_cycles(const chip8_t* c8, uint16_t opcode)
+{
+  const uint8_t inst_x = (opcode >> 8) & 0x0F;
+  const uint8_t inst_n = opcode & 0x0F;
+
+  if ((opcode >> 12) == 0x0D)
+  {
+    const uint8_t shift = c8->emu_V[inst_x] & 7;
+    const uint32_t row_cycles = (shift == 0) ? VIP_DRAW_ALIGNED_ROW_CYCLES : VIP_DRAW_UNALIGNED_ROW_CYCLES + shift * VIP_DRAW_SHIFT_CYCLES;
+    return inst_n * row_cycles;
+  }
+
+  switch (opcode & 0x00FF)
+  {
+    case 0x1E:  return 8;
+    case 0x29:  return 10;
+
+    case 0x33:
+    {
+      const uint8_t value = c8->emu_V[inst_x];
+      return 14 + (value / 100 + (value / 10) % 10 + value % 10) * VIP_BCD_SUBTRACT_CYCLES;
+    }
+
+    case 0x55:
+    case 0x65:  return 4 + (inst_x + 1) * VIP_REGISTER_COPY_CYCLES;
+
+    default:    return 0;
+  }
+}
+
+
+// Machine cycles the VIP interpreter spends on the instruction at PC (before it runs)
+static inline uint32_t vip_instruction_cycles(const chip8_t* c8, uint16_t opcode)
+{
+  const uint8_t inst_op = opcode >> 12;
+  uint32_t cycles = VIP_FETCH_CYCLES + vip_op_cycles[inst_op];
+
+  if (VIP_VARIABLE_COST_OPS & (1u << inst_op))
+    cycles += vip_variable_cycles(c8, opcode);
+
+  return cycles;
+}
+
+
+// Start a frame from the previous frame's carry (the overrun already spent)
+void vip_begin_frame(vip_timing_t* timing)
+{
+  timing->frame_cycles = timing->carry_cycles;
+  timing->display_wait = false;
+  timing->frame_instructions = 0;
+}
+
+
+// True while the frame still has cycles before cycle_target and nothing has ended it
+static inline bool vip_frame_running(const vip_timing_t* timing, const chip8_t* c8, int32_t cycle_target)
+{
+  return timing->frame_cycles < cycle_target && !timing->display_wait && c8->emu_state == RUNNING;
+}
+
+
+// Charge an instruction that ran to the frame
+static inline void vip_charge_instruction(vip_timing_t* timing, uint16_t opcode, uint32_t cycles)
+{
+  timing->frame_cycles += cycles;
+  timing->frame_instructions++;
+
+  // The VIP interpreter waits for the next display interrupt before drawing, nothing else runs this frame
+  if ((opcode >> 12) == 0x0D)
+    timing->display_wait = true;
+}
+
+
+// Run instructions until frame_cycles reaches cycle_target, a sprite draw waits for the display or emulation stops
+// The dispatch path is picked once per call like the main loop does, so the plain path pays nothing for the debugger or tracer
+void emulate_vip_cycles(vip_timing_t* timing, chip8_t* c8, user_config_params_t* cfg, debugger_params_t* dbg, trace_params_t* tracer, uint32_t cycle_target)
+{
+  const int32_t target = (int32_t)cycle_target;
+
+  if (dbg->armed)
+  {
+    while (vip_frame_running(timing, c8, target))
+    {
+      const uint16_t pc = c8->emu_pc;
+      const uint16_t opcode = (c8->emu_ram[pc & 0x0FFF] << 8) | c8->emu_ram[(pc + 1) & 0x0FFF];
+      const uint32_t cycles = vip_instruction_cycles(c8, opcode);
+
+      debug_emulate_instructions(dbg, c8, cfg, 1);
+
+      // Stopped on a breakpoint before the instruction ran, it is charged once emulation resumes
+      if (c8->emu_state != RUNNING && c8->emu_pc == pc)
+        break;
+
+      vip_charge_instruction(timing, opcode, cycles);
+    }
+  }
+  else if (tracer->active)
+  {
+    while (vip_frame_running(timing, c8, target))
+    {
+      const uint16_t pc = c8->emu_pc;
+      const uint16_t opcode = (c8->emu_ram[pc & 0x0FFF] << 8) | c8->emu_ram[(pc + 1) & 0x0FFF];
+      const uint32_t cycles = vip_instruction_cycles(c8, opcode);
+
+      trace_emulate_instruction(tracer, c8, cfg);
+      vip_charge_instruction(timing, opcode, cycles);
+    }
+  }
+  else
+  {
+    while (vip_frame_running(timing, c8, target))
+    {
+      const uint16_t pc = c8->emu_pc;
+      const uint16_t opcode = (c8->emu_ram[pc & 0x0FFF] << 8) | c8->emu_ram[(pc + 1) & 0x0FFF];
+      const uint32_t cycles = vip_instruction_cycles(c8, opcode);
+
+      emulate_instructions(c8, cfg);
+      vip_charge_instruction(timing, opcode, cycles);
+    }
+  }
+}
+
+
+// End a frame: carry its overrun into the next one and count the instructions it ran
+void vip_end_frame(vip_timing_t* timing)
+{
+  // Budget left by a display wait is lost like on the VIP, only the cycles the last instruction overran by are carried
+  timing->carry_cycles = timing->frame_cycles - VIP_FRAME_CYCLE_BUDGET;
+  if (timing->carry_cycles < 0)
+    timing->carry_cycles = 0;
+
+  if (timing->num_frames == 0 || timing->frame_instructions < timing->min_frame_instructions)
+    timing->min_frame_instructions = timing->frame_instructions;
+  if (timing->frame_instructions > timing->max_frame_instructions)
+    timing->max_frame_instructions = timing->frame_instructions;
+
+  timing->num_frames++;
+  timing->total_instructions += timing->frame_instructions;
+  timing->display_wait_frames += timing->display_wait ? 1 : 0;
+}
+
+
+// Print the instructions per frame the VIP timing model ran
+void report_vip_timing(vip_timing_t* timing)
+{
+  if (timing->num_frames == 0)
+  {
+    printf("VIP timing: no frames emulated\n");
+    return;
+  }
+
+  const double mean = (double)timing->total_instructions / timing->num_frames;
+  printf("VIP timing over %llu frames: mean %.1f instructions/frame (%.0f/s), min %u, max %u, %.1f%% of frames ended by a draw\n",
+         (unsigned long long)timing->num_frames, mean, mean * 60, (unsigned int)timing->min_frame_instructions,
+         (unsigned int)timing->max_frame_instructions, 100.0 * timing->display_wait_frames / timing->num_frames);
+}
@@ -0,0 +1,358 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <sched.h>
+#include <time.h>
+
+#include "chip8Emu.h"
+
+
+
+// Little endian writers for the trace file
+static void trace_put_u16(FILE* file, uint16_t value)
+{
+  fputc(value & 0xFF, file);
+  fputc(value >> 8, file);
+}
+
+
+static void trace_put_u64(FILE* file, uint64_t value)
+{
+  for (uint8_t i=0; i<8; i++)
+    fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+
+// Keyframe block: full state before instruction <index>, the following records are delta encoded against it
+static void trace_write_keyframe(trace_params_t* tracer, const trace_keyframe_t* keyframe)
+{
+  FILE* file = tracer->file;
+
+  fputc(TRACE_TAG_KEYFRAME, file);
+  trace_put_u64(file, keyframe->index);
+  fwrite(keyframe->ram, sizeof(keyframe->ram), 1, file);
+
+  for (uint32_t i=0; i<sizeof(keyframe->display); i++)
+    fputc(keyframe->display[i] ? 1 : 0, file);
+
+  fwrite(keyframe->V, sizeof(keyframe->V), 1, file);
+  trace_put_u16(file, keyframe->I);
+  trace_put_u16(file, keyframe->pc);
+  fputc(keyframe->sp, file);
+  fputc(keyframe->delay_timer, file);
+  fputc(keyframe->sound_timer, file);
+
+  for (uint8_t i=0; i<12; i++)
+    trace_put_u16(file, keyframe->stack[i]);
+
+  tracer->encoder_primed = true;
+  tracer->prev_pc = keyframe->pc - 2;
+  tracer->prev_I = keyframe->I;
+  tracer->prev_sp = keyframe->sp;
+  tracer->prev_delay_timer = keyframe->delay_timer;
+  tracer->prev_sound_timer = keyframe->sound_timer;
+}
+
+
+// Record block: only what differs from the previous record is written
+static void trace_write_record(trace_params_t* tracer, const trace_record_t* record)
+{
+  FILE* file = tracer->file;
+  const bool primed = tracer->encoder_primed;
+  uint8_t tag = 0;
+
+  if (!primed || record->pc != (uint16_t)(tracer->prev_pc + 2))   tag |= TRACE_TAG_PC;
+  if (!primed || record->I != tracer->prev_I)                     tag |= TRACE_TAG_I;
+  if (record->changed_v != 0)                                     tag |= TRACE_TAG_V;
+  if (record->mem_len != 0)                                       tag |= TRACE_TAG_MEM;
+  if (!primed || record->sp != tracer->prev_sp)                   tag |= TRACE_TAG_SP;
+  if (!primed || record->delay_timer != tracer->prev_delay_timer) tag |= TRACE_TAG_DELAY;
+  if (!primed || record->sound_timer != tracer->prev_sound_timer) tag |= TRACE_TAG_SOUND;
+
+  fputc(tag, file);
+  trace_put_u16(file, record->opcode);
+
+  if (tag & TRACE_TAG_PC)
+    trace_put_u16(file, record->pc);
+
+  if (tag & TRACE_TAG_I)
+    trace_put_u16(file, record->I);
+
+  if (tag & TRACE_TAG_V)
+  {
+    trace_put_u16(file, record->changed_v);
+    fwrite(record->data, __builtin_popcount(record->changed_v), 1, file);
+  }
+
+  if (tag & TRACE_TAG_MEM)
+  {
+    trace_put_u16(file, record->mem_addr);
+    fputc(record->mem_len, file);
+    fwrite(record->data, record->mem_len, 1, file);
+  }
+
+  if (tag & TRACE_TAG_SP)     fputc(record->sp, file);
+  if (tag & TRACE_TAG_DELAY)  fputc(record->delay_timer, file);
+  if (tag & TRACE_TAG_SOUND)  fputc(record->sound_timer, file);
+
+  tracer->encoder_primed = true;
+  tracer->prev_pc = record->pc;
+  tracer->prev_I = record->I;
+  tracer->prev_sp = record->sp;
+  tracer->prev_delay_timer = record->delay_timer;
+  tracer->prev_sound_timer = record->sound_timer;
+}
+
+
+// File header: magic and the index of the first record in the file
+static void trace_write_header(trace_params_t* tracer, uint64_t first_index)
+{
+  fwrite(TRACE_FILE_MAGIC, 8, 1, tracer->file);
+  trace_put_u64(tracer->file, first_index);
+  tracer->encoder_primed = false;
+}
+
+
+// Streaming writer thread: drain the ring into the file until told to stop
+static void* trace_writer_thread(void* arg)
+{
+  trace_params_t* tracer = arg;
+  const struct timespec idle_sleep = {.tv_sec = 0, .tv_nsec = 1000000};
+
+  while (true)
+  {
+    uint64_t tail = atomic_load_explicit(&tracer->tail, memory_order_relaxed);
+    const uint64_t head = atomic_load_explicit(&tracer->head, memory_order_acquire);
+    const uint64_t keyframe_head = atomic_load_explicit(&tracer->keyframe_head, memory_order_acquire);
+
+    for (; tail<head; tail++)
+    {
+      // Keyframes go in front of the record they were taken before
+      const trace_keyframe_t* keyframe = &tracer->keyframes[tracer->keyframe_tail % tracer->num_keyframe_slots];
+      if (tracer->keyframe_tail < keyframe_head && keyframe->index == tail)
+      {
+        trace_write_keyframe(tracer, keyframe);
+        tracer->keyframe_tail++;
+      }
+
+      trace_write_record(tracer, &tracer->records[tail & (tracer->capacity - 1)]);
+
+      // Hand slots back in batches so the emulator is not waiting on a whole drain
+      if ((tail & 0xFFF) == 0xFFF)
+        atomic_store_explicit(&tracer->tail, tail + 1, memory_order_release);
+    }
+
+    atomic_store_explicit(&tracer->tail, tail, memory_order_release);
+
+    if (head == tail && atomic_load_explicit(&tracer->stop_writer, memory_order_acquire) &&
+        head == atomic_load_explicit(&tracer->head, memory_order_acquire))
+      break;
+
+    if (head == tail)
+      nanosleep(&idle_sleep, NULL);
+  }
+
+  return NULL;
+}
+
+
+// Allocate the trace ring and, when streaming, open the file and start the writer thread (return true if initialized)
+bool init_tracer(trace_params_t* tracer, user_config_params_t* cfg)
+{
+  memset(tracer, 0, sizeof(*tracer));
+  tracer->path = cfg->trace_path;
+  tracer->flight_recorder = cfg->trace_flight_recorder;
+
+  // Round the ring up to a power of 2 so the slot is just index & (capacity - 1)
+  tracer->capacity = 1024;
+  while (tracer->capacity < cfg->trace_records && tracer->capacity < (1u << 30))
+    tracer->capacity <<= 1;
+
+  // A dumped flight recorder has to start near a keyframe, so small rings keyframe more often
+  tracer->keyframe_interval = TRACE_KEYFRAME_INTERVAL;
+  while (tracer->keyframe_interval > tracer->capacity / 4)
+    tracer->keyframe_interval >>= 1;
+
+  // Enough keyframes to cover the whole ring plus the ones being written
+  tracer->num_keyframe_slots = tracer->capacity / tracer->keyframe_interval + 2;
+
+  tracer->records = malloc((size_t)tracer->capacity * sizeof(trace_record_t));
+  tracer->keyframes = malloc((size_t)tracer->num_keyframe_slots * sizeof(trace_keyframe_t));
+  if (tracer->records == NULL || tracer->keyframes == NULL)
+  {
+    SDL_Log("Could not allocate trace buffer of %u records ... exiting!", (unsigned int)tracer->capacity);
+    free(tracer->records);
+    free(tracer->keyframes);
+    return false;
+  }
+
+  // Flight recorder only opens the file when dumping
+  if (!tracer->flight_recorder)
+  {
+    tracer->file = fopen(tracer->path, "wb");
+    if (tracer->file == NULL)
+    {
+      SDL_Log("Could not open trace file %s ... exiting!", tracer->path);
+      free(tracer->records);
+      free(tracer->keyframes);
+      return false;
+    }
+
+    trace_write_header(tracer, 0);
+
+    if (pthread_create(&tracer->writer_thread, NULL, trace_writer_thread, tracer) != 0)
+    {
+      SDL_Log("Could not start trace writer thread ... exiting!");
+      fclose(tracer->file);
+      free(tracer->records);
+      free(tracer->keyframes);
+      return false;
+    }
+  }
+
+  tracer->active = true;
+  return true;
+}
+
+
+// Emulate one instruction and record what it changed
+void trace_emulate_instruction(trace_params_t* tracer, chip8_t* c8, user_config_params_t* cfg)
+{
+  const uint64_t index = atomic_load_explicit(&tracer->head, memory_order_relaxed);
+
+  // Streaming never loses records, wait for the writer if the ring is full
+  while (!tracer->flight_recorder && index - atomic_load_explicit(&tracer->tail, memory_order_acquire) >= tracer->capacity)
+    sched_yield();
+
+  if ((index & (tracer->keyframe_interval - 1)) == 0)
+  {
+    const uint64_t keyframe_head = atomic_load_explicit(&tracer->keyframe_head, memory_order_relaxed);
+    trace_keyframe_t* keyframe = &tracer->keyframes[keyframe_head % tracer->num_keyframe_slots];
+
+    keyframe->index = index;
+    memcpy(keyframe->ram, c8->emu_ram, sizeof(keyframe->ram));
+    memcpy(keyframe->display, c8->emu_display, sizeof(keyframe->display));
+    memcpy(keyframe->V, c8->emu_V, sizeof(keyframe->V));
+    memcpy(keyframe->stack, c8->emu_subrStack, sizeof(keyframe->stack));
+    keyframe->I = c8->emu_I;
+    keyframe->pc = c8->emu_pc;
+    keyframe->sp = c8->emu_subrStack_ptr - &c8->emu_subrStack[0];
+    keyframe->delay_timer = c8->emu_delayTimer;
+    keyframe->sound_timer = c8->emu_soundTimer;
+
+    atomic_store_explicit(&tracer->keyframe_head, keyframe_head + 1, memory_order_release);
+  }
+
+  // Opcode is read first in case the instruction overwrites itself
+  const uint16_t pc = c8->emu_pc;
+  const uint16_t opcode = (c8->emu_ram[pc & 0x0FFF] << 8) | c8->emu_ram[(pc + 1) & 0x0FFF];
+  const uint16_t I_before = c8->emu_I;
+  uint8_t V_before[16];
+  memcpy(V_before, c8->emu_V, sizeof(V_before));
+
+  emulate_instructions(c8, cfg);
+
+  trace_record_t* record = &tracer->records[index & (tracer->capacity - 1)];
+  record->pc = pc;
+  record->opcode = opcode;
+  record->I = c8->emu_I;
+  record->sp = c8->emu_subrStack_ptr - &c8->emu_subrStack[0];
+  record->delay_timer = c8->emu_delayTimer;
+  record->sound_timer = c8->emu_soundTimer;
+  record->changed_v = 0;
+  record->mem_len = 0;
+
+  uint8_t num_changed = 0;
+  for (uint8_t i=0; i<16; i++)
+  {
+    if (c8->emu_V[i] != V_before[i])
+    {
+      record->changed_v |= 1 << i;
+      record->data[num_changed++] = c8->emu_V[i];
+    }
+  }
+
+  // FX33 and FX55 are the only RAM writes (and never change V)
+  const uint16_t opcode_fx = record->opcode & 0xF0FF;
+  if (opcode_fx == 0xF033 || opcode_fx == 0xF055)
+  {
+    record->mem_addr = I_before;
+    record->mem_len = (opcode_fx == 0xF033) ? 3 : ((record->opcode >> 8) & 0x0F) + 1;
+
+    for (uint8_t i=0; i<record->mem_len; i++)
+      record->data[i] = c8->emu_ram[(I_before + i) & 0x0FFF];
+  }
+
+  atomic_store_explicit(&tracer->head, index + 1, memory_order_release);
+}
+
+
+// Flight recorder: write the instructions currently held in memory to the trace file
+void trace_dump(trace_params_t* tracer)
+{
+  if (!tracer->active || !tracer->flight_recorder)
+    return;
+
+  tracer->file = fopen(tracer->path, "wb");
+  if (tracer->file == NULL)
+  {
+    SDL_Log("Could not open trace file %s", tracer->path);
+    return;
+  }
+
+  const uint64_t head = atomic_load_explicit(&tracer->head, memory_order_relaxed);
+  const uint64_t oldest = (head > tracer->capacity) ? head - tracer->capacity : 0;
+
+  // Oldest keyframe still inside the ring
+  const uint64_t keyframe_head = atomic_load_explicit(&tracer->keyframe_head, memory_order_relaxed);
+  uint64_t keyframe_next = (keyframe_head > tracer->num_keyframe_slots) ? keyframe_head - tracer->num_keyframe_slots : 0;
+  while (keyframe_next < keyframe_head && tracer->keyframes[keyframe_next % tracer->num_keyframe_slots].index < oldest)
+    keyframe_next++;
+
+  trace_write_header(tracer, oldest);
+
+  for (uint64_t index=oldest; index<head; index++)
+  {
+    const trace_keyframe_t* keyframe = &tracer->keyframes[keyframe_next % tracer->num_keyframe_slots];
+    if (keyframe_next < keyframe_head && keyframe->index == index)
+    {
+      trace_write_keyframe(tracer, keyframe);
+      keyframe_next++;
+    }
+
+    trace_write_record(tracer, &tracer->records[index & (tracer->capacity - 1)]);
+  }
+
+  fclose(tracer->file);
+  tracer->file = NULL;
+
+  SDL_Log("Trace: wrote instructions %llu to %llu to %s", (unsigned long long)oldest, (unsigned long long)head, tracer->path);
+}
+
+
+// Stop the writer thread (or dump the flight recorder) and free the ring
+void close_tracer(trace_params_t* tracer)
+{
+  if (!tracer->active)
+    return;
+
+  if (tracer->flight_recorder)
+  {
+    trace_dump(tracer);
+  }
+  else
+  {
+    atomic_store_explicit(&tracer->stop_writer, true, memory_order_release);
+    pthread_join(tracer->writer_thread, NULL);
+    fclose(tracer->file);
+    SDL_Log("Trace: wrote %llu instructions to %s", (unsigned long long)atomic_load(&tracer->head), tracer->path);
+  }
+
+  free(tracer->records);
+  free(tracer->keyframes);
+  tracer->active = false;
+}
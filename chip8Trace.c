@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "chip8Emu.h"
+
+// Offline query tool for trace files written by chip8Emu --trace
+
+
+
+// Reader state: the record stream is decoded against prev_*, and replayed onto state once a keyframe has been seen
+typedef struct
+{
+  FILE* file;
+  uint64_t next_index;
+
+  uint16_t prev_pc;
+  uint16_t prev_I;
+  uint8_t prev_sp;
+  uint8_t prev_delay_timer;
+  uint8_t prev_sound_timer;
+
+  bool has_state;
+  trace_keyframe_t state;
+} trace_reader_t;
+
+
+typedef enum
+{
+  BLOCK_END = 0,
+  BLOCK_RECORD = 1,
+  BLOCK_KEYFRAME = 2
+} trace_block_t;
+
+
+
+static bool read_bytes(trace_reader_t* reader, void* out, size_t length)
+{
+  return fread(out, 1, length, reader->file) == length;
+}
+
+
+static bool read_u16(trace_reader_t* reader, uint16_t* value)
+{
+  uint8_t bytes[2];
+  if (!read_bytes(reader, bytes, 2))
+    return false;
+
+  *value = bytes[0] | (bytes[1] << 8);
+  return true;
+}
+
+
+static bool read_u64(trace_reader_t* reader, uint64_t* value)
+{
+  uint8_t bytes[8];
+  if (!read_bytes(reader, bytes, 8))
+    return false;
+
+  *value = 0;
+  for (uint8_t i=0; i<8; i++)
+    *value |= (uint64_t)bytes[i] << (8 * i);
+  return true;
+}
+
+
+// Open a trace file and check its header
+static bool open_trace(trace_reader_t* reader, const char* path)
+{
+  memset(reader, 0, sizeof(*reader));
+
+  reader->file = fopen(path, "rb");
+  if (reader->file == NULL)
+  {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+
+  char magic[8];
+  if (!read_bytes(reader, magic, 8) || memcmp(magic, TRACE_FILE_MAGIC, 8) != 0 || !read_u64(reader, &reader->next_index))
+  {
+    fprintf(stderr, "%s is not a chip8Emu trace file\n", path);
+    fclose(reader->file);
+    return false;
+  }
+
+  return true;
+}
+
+
+// Replay one record onto the reconstructed state (mirrors what emulate_instructions did)
+static void apply_record(trace_keyframe_t* state, const trace_record_t* record)
+{
+  const uint8_t inst_op = record->opcode >> 12;
+  const uint8_t inst_x = (record->opcode >> 8) & 0x0F;
+  const uint8_t inst_y = (record->opcode >> 4) & 0x0F;
+  const uint8_t inst_n = record->opcode & 0x0F;
+
+  // Display changes are not stored, redraw them from the state before the instruction
+  if (record->opcode == 0x00E0)
+  {
+    memset(state->display, 0, sizeof(state->display));
+  }
+  else if (inst_op == 0x0D)
+  {
+    const uint8_t x_start = state->V[inst_x] % 64;
+    uint8_t y_cor = state->V[inst_y] % 32;
+
+    for (uint8_t i=0; i<inst_n && y_cor<32; i++, y_cor++)
+    {
+      const uint8_t sprite_data = state->ram[(state->I + i) & 0x0FFF];
+      for (uint8_t j=0; j<8 && x_start+j<64; j++)
+        state->display[y_cor * 64 + x_start + j] ^= (sprite_data >> (7 - j)) & 0x01;
+    }
+  }
+
+  // 2NNN pushes the return address
+  if (inst_op == 0x02 && state->sp < 12)
+    state->stack[state->sp] = record->pc + 2;
+
+  uint8_t data_index = 0;
+  for (uint8_t i=0; i<16; i++)
+  {
+    if (record->changed_v & (1 << i))
+      state->V[i] = record->data[data_index++];
+  }
+
+  for (uint8_t i=0; i<record->mem_len; i++)
+    state->ram[(record->mem_addr + i) & 0x0FFF] = record->data[i];
+
+  state->I = record->I;
+  state->sp = record->sp;
+  state->delay_timer = record->delay_timer;
+  state->sound_timer = record->sound_timer;
+
+  // Real next PC comes from the next record
+  state->pc = record->pc + 2;
+}
+
+
+// Decode the next block, records are also replayed onto the state
+static trace_block_t read_block(trace_reader_t* reader, trace_record_t* record, uint64_t* index)
+{
+  const int tag = fgetc(reader->file);
+  if (tag == EOF)
+    return BLOCK_END;
+
+  if (tag & TRACE_TAG_KEYFRAME)
+  {
+    trace_keyframe_t* state = &reader->state;
+    uint8_t display_bytes[sizeof(state->display)];
+
+    bool ok = read_u64(reader, &state->index) && read_bytes(reader, state->ram, sizeof(state->ram)) &&
+              read_bytes(reader, display_bytes, sizeof(display_bytes)) && read_bytes(reader, state->V, sizeof(state->V)) &&
+              read_u16(reader, &state->I) && read_u16(reader, &state->pc) &&
+              read_bytes(reader, &state->sp, 1) && read_bytes(reader, &state->delay_timer, 1) && read_bytes(reader, &state->sound_timer, 1);
+
+    for (uint8_t i=0; ok && i<12; i++)
+      ok = read_u16(reader, &state->stack[i]);
+
+    if (!ok)
+      return BLOCK_END;
+
+    for (uint32_t i=0; i<sizeof(display_bytes); i++)
+      state->display[i] = display_bytes[i];
+
+    reader->has_state = true;
+    reader->next_index = state->index;
+    reader->prev_pc = state->pc - 2;
+    reader->prev_I = state->I;
+    reader->prev_sp = state->sp;
+    reader->prev_delay_timer = state->delay_timer;
+    reader->prev_sound_timer = state->sound_timer;
+    *index = state->index;
+    return BLOCK_KEYFRAME;
+  }
+
+  memset(record, 0, sizeof(*record));
+  record->pc = reader->prev_pc + 2;
+  record->I = reader->prev_I;
+  record->sp = reader->prev_sp;
+  record->delay_timer = reader->prev_delay_timer;
+  record->sound_timer = reader->prev_sound_timer;
+
+  bool ok = read_u16(reader, &record->opcode);
+  if (ok && (tag & TRACE_TAG_PC))     ok = read_u16(reader, &record->pc);
+  if (ok && (tag & TRACE_TAG_I))      ok = read_u16(reader, &record->I);
+  if (ok && (tag & TRACE_TAG_V))      ok = read_u16(reader, &record->changed_v) && read_bytes(reader, record->data, __builtin_popcount(record->changed_v));
+  if (ok && (tag & TRACE_TAG_MEM))    ok = read_u16(reader, &record->mem_addr) && read_bytes(reader, &record->mem_len, 1) && record->mem_len <= 16 && read_bytes(reader, record->data, record->mem_len);
+  if (ok && (tag & TRACE_TAG_SP))     ok = read_bytes(reader, &record->sp, 1);
+  if (ok && (tag & TRACE_TAG_DELAY))  ok = read_bytes(reader, &record->delay_timer, 1);
+  if (ok && (tag & TRACE_TAG_SOUND))  ok = read_bytes(reader, &record->sound_timer, 1);
+
+  if (!ok)
+  {
+    fprintf(stderr, "Trace file is truncated\n");
+    return BLOCK_END;
+  }
+
+  reader->prev_pc = record->pc;
+  reader->prev_I = record->I;
+  reader->prev_sp = record->sp;
+  reader->prev_delay_timer = record->delay_timer;
+  reader->prev_sound_timer = record->sound_timer;
+
+  if (reader->has_state)
+    apply_record(&reader->state, record);
+
+  *index = reader->next_index++;
+  return BLOCK_RECORD;
+}
+
+
+// One line per record: index, PC, opcode and what changed
+static void print_record(uint64_t index, const trace_record_t* record)
+{
+  printf("%10llu  %03X  %04X ", (unsigned long long)index, record->pc, record->opcode);
+
+  uint8_t data_index = 0;
+  for (uint8_t i=0; i<16; i++)
+  {
+    if (record->changed_v & (1 << i))
+      printf(" V%X=%02X", i, record->data[data_index++]);
+  }
+
+  if (record->mem_len > 0)
+  {
+    printf(" [%03X]=", record->mem_addr);
+    for (uint8_t i=0; i<record->mem_len; i++)
+      printf("%02X", record->data[i]);
+  }
+
+  printf("  I=%03X SP=%u DT=%02X ST=%02X\n", record->I, record->sp, record->delay_timer, record->sound_timer);
+}
+
+
+// Registers, stack and display of a reconstructed state
+static void print_state(const trace_keyframe_t* state)
+{
+  printf("PC=%03X  I=%03X  DT=%02X  ST=%02X\n", state->pc, state->I, state->delay_timer, state->sound_timer);
+
+  for (uint8_t i=0; i<16; i++)
+    printf("V%X=%02X%s", i, state->V[i], (i % 8 == 7) ? "\n" : "  ");
+
+  printf("Stack:");
+  for (uint8_t i=0; i<state->sp && i<12; i++)
+    printf(" %03X", state->stack[i]);
+  printf("\n");
+
+  for (uint8_t y=0; y<32; y++)
+  {
+    for (uint8_t x=0; x<64; x++)
+      putchar(state->display[y * 64 + x] ? '#' : '.');
+    putchar('\n');
+  }
+}
+
+
+static void print_usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s <trace> list [FIRST] [COUNT]   print records\n"
+          "       %s <trace> writer ADDR            last instruction that wrote RAM at ADDR\n"
+          "       %s <trace> reg X                  instructions that changed VX (e.g. reg F)\n"
+          "       %s <trace> state INDEX            machine state before instruction INDEX\n",
+          program, program, program, program);
+}
+
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  trace_reader_t* reader = malloc(sizeof(trace_reader_t));
+  if (reader == NULL || !open_trace(reader, argv[1]))
+    return EXIT_FAILURE;
+
+  const char* command = argv[2];
+  const uint64_t arg_1 = (argc > 3) ? strtoull(argv[3], NULL, strcmp(command, "list") == 0 || strcmp(command, "state") == 0 ? 0 : 16) : 0;
+  const uint64_t arg_2 = (argc > 4) ? strtoull(argv[4], NULL, 0) : UINT64_MAX;
+
+  trace_record_t record;
+  uint64_t index = 0;
+  trace_block_t block;
+
+  uint64_t last_writer_index = UINT64_MAX;
+  trace_record_t last_writer;
+
+  while ((block = read_block(reader, &record, &index)) != BLOCK_END)
+  {
+    // Replayed state is the one before INDEX once INDEX-1 has been applied or a keyframe for INDEX was read
+    if (strcmp(command, "state") == 0)
+    {
+      if ((block == BLOCK_KEYFRAME && index == arg_1) || (block == BLOCK_RECORD && index + 1 == arg_1))
+        break;
+    }
+
+    if (block != BLOCK_RECORD)
+      continue;
+
+    if (strcmp(command, "list") == 0)
+    {
+      if (index >= arg_1 && index - arg_1 < arg_2)
+        print_record(index, &record);
+    }
+
+    else if (strcmp(command, "writer") == 0)
+    {
+      if (record.mem_len > 0 && ((arg_1 - record.mem_addr) & 0x0FFF) < record.mem_len)
+      {
+        last_writer_index = index;
+        last_writer = record;
+      }
+    }
+
+    else if (strcmp(command, "reg") == 0)
+    {
+      if (record.changed_v & (1 << (arg_1 & 0x0F)))
+        print_record(index, &record);
+    }
+  }
+
+  int exit_code = EXIT_SUCCESS;
+
+  if (strcmp(command, "writer") == 0)
+  {
+    if (last_writer_index != UINT64_MAX)
+      print_record(last_writer_index, &last_writer);
+    else
+      printf("No write to %03llX in the trace\n", (unsigned long long)arg_1);
+  }
+
+  else if (strcmp(command, "state") == 0)
+  {
+    if (block == BLOCK_END || !reader->has_state)
+    {
+      printf("Instruction %llu is not covered by a keyframe in the trace\n", (unsigned long long)arg_1);
+      exit_code = EXIT_FAILURE;
+    }
+    else
+    {
+      // Replay only guesses the PC after a jump, the record of INDEX itself has the real one
+      trace_keyframe_t state = reader->state;
+      if (block == BLOCK_RECORD && read_block(reader, &record, &index) == BLOCK_RECORD)
+        state.pc = record.pc;
+
+      printf("State before instruction %llu:\n", (unsigned long long)arg_1);
+      print_state(&state);
+    }
+  }
+
+  else if (strcmp(command, "list") != 0 && strcmp(command, "reg") != 0)
+  {
+    print_usage(argv[0]);
+    exit_code = EXIT_FAILURE;
+  }
+
+  fclose(reader->file);
+  free(reader);
+  return exit_code;
+}
@@ -0,0 +1,129 @@
+// Render kernel check: draws the same random frames through the scaler kernels in every mode and prints one hash per mode
+// tests/run_render_check.sh builds this once with the portable kernels (CHIP8_SCALAR_RENDER) and once per SIMD level,
+// every build has to print the same hashes
+#include "../chip8Emu_render.c"
+
+#define RENDER_CHECK_FRAMES 200
+
+typedef struct
+{
+  const char* name;
+  uint32_t display_width;
+  uint32_t display_height;
+  uint32_t scale_factor;
+  render_filter_t render_filter;
+  uint8_t phosphor_decay;
+} render_check_mode_t;
+
+// The odd sizes leave a scalar tail after the vector loop of every kernel
+static const render_check_mode_t render_check_modes[] =
+{
+  {"nearest",            64,  32, 15, RENDER_NEAREST, 0},
+  {"nearest-phosphor",   64,  32, 15, RENDER_NEAREST, 200},
+  {"scale2x",            64,  32, 15, RENDER_SCALE2X, 0},
+  {"scale2x-phosphor",   64,  32,  7, RENDER_SCALE2X, 180},
+  {"scale2x-128x64",    128,  64,  5, RENDER_SCALE2X, 0},
+  {"nearest-odd",        61,  29,  3, RENDER_NEAREST, 150},
+  {"scale2x-odd",        61,  29,  3, RENDER_SCALE2X, 90},
+};
+
+
+
+// 64 bit FNV-1a over the frame, folded into the running hash
+static uint64_t render_check_hash(uint64_t hash, const uint32_t* pixels, size_t num_pixels)
+{
+  for (size_t i=0; i<num_pixels; i++)
+  {
+    for (uint32_t shift=0; shift<32; shift+=8)
+    {
+      hash ^= (pixels[i] >> shift) & 0xFF;
+      hash *= 0x100000001B3ull;
+    }
+  }
+
+  return hash;
+}
+
+
+// Hash of every frame of one mode (false if out of memory)
+static bool render_check_mode(const render_check_mode_t* mode, uint64_t* hash)
+{
+  user_config_params_t cfg = {0};
+  cfg.window_width = mode->display_width;
+  cfg.window_height = mode->display_height;
+  cfg.scale_factor = mode->scale_factor;
+  cfg.render_filter = mode->render_filter;
+  cfg.phosphor_decay = mode->phosphor_decay;
+  cfg.fg_color = 0xFFB000FF;
+  cfg.bg_color = 0x202040FF;
+
+  const size_t display_size = (size_t)mode->display_width * mode->display_height;
+  render_params_t* render = alloc_render_params(&cfg);
+  bool* display = calloc(display_size, sizeof(bool));
+  uint32_t* pixels = (render != NULL) ? malloc((size_t)render->out_width * render->out_height * sizeof(uint32_t)) : NULL;
+
+  if (render == NULL || display == NULL || pixels == NULL)
+  {
+    free_render_params(render);
+    free(display);
+    free(pixels);
+    return false;
+  }
+
+  // Each frame flips about a quarter of the pixels, so phosphor glow builds up and decays like it does under XOR sprites
+  uint32_t rng_state = 1;
+  *hash = 0xCBF29CE484222325ull;
+
+  for (uint32_t frame=0; frame<RENDER_CHECK_FRAMES; frame++)
+  {
+    for (size_t i=0; i<display_size; i++)
+    {
+      rng_state = rng_state * 1664525u + 1013904223u;
+      if ((rng_state >> 30) == 0)
+        display[i] = !display[i];
+    }
+
+    // Same steps as render_filtered_frame, into plain memory instead of a texture
+    render_update_intensity(render, display, cfg.phosphor_decay);
+
+    const uint8_t* source = render->intensity;
+    uint32_t source_stride = render->intensity_stride;
+    uint32_t source_height = render->display_height;
+
+    if (cfg.render_filter == RENDER_SCALE2X)
+    {
+      render_scale2x(render);
+      source = render->scaled;
+      source_stride = render->display_width * 2;
+      source_height = render->display_height * 2;
+    }
+
+    render_expand_nearest(render, source, source_stride, source_height, (uint8_t*)pixels, render->out_width * sizeof(uint32_t));
+    *hash = render_check_hash(*hash, pixels, (size_t)render->out_width * render->out_height);
+  }
+
+  free_render_params(render);
+  free(display);
+  free(pixels);
+  return true;
+}
+
+
+int main(void)
+{
+  fprintf(stderr, "Render kernels: %d pixels per vector\n", PIX_VEC_WIDTH);
+
+  for (size_t m=0; m<sizeof(render_check_modes) / sizeof(render_check_modes[0]); m++)
+  {
+    uint64_t hash = 0;
+    if (!render_check_mode(&render_check_modes[m], &hash))
+    {
+      fprintf(stderr, "Out of memory in mode %s\n", render_check_modes[m].name);
+      return EXIT_FAILURE;
+    }
+
+    printf("%-20s %016llx\n", render_check_modes[m].name, (unsigned long long)hash);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+; flags.ch8: VX and VF after 8XY1-8XYE, including X = F (the flag must win) and Y = F
+; Case N stores VX then VF at results + 2*N, the 34 bytes are then drawn as hex (7 per row)
+; Without quirks VF is untouched by OR/AND/XOR, 1 on carry / no borrow / shifted out bit, else 0
+
+start:
+  ;  0: OR
+  LD VA, $0F
+  LD VB, $F0
+  LD VF, $55
+  OR VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 0
+  LD [I], V1
+
+  ;  1: AND
+  LD VA, $3C
+  LD VB, $0F
+  LD VF, $55
+  AND VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 2
+  LD [I], V1
+
+  ;  2: XOR
+  LD VA, $3C
+  LD VB, $0F
+  LD VF, $55
+  XOR VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 4
+  LD [I], V1
+
+  ;  3: ADD, no carry clears VF
+  LD VA, $10
+  LD VB, $20
+  LD VF, $01
+  ADD VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 6
+  LD [I], V1
+
+  ;  4: ADD, carry
+  LD VA, $FF
+  LD VB, $02
+  LD VF, $00
+  ADD VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 8
+  LD [I], V1
+
+  ;  5: ADD VF, VB: flag wins
+  LD VB, $90
+  LD VF, $80
+  ADD VF, VB
+  LD V0, VF
+  LD V1, VF
+  LD I, results + 10
+  LD [I], V1
+
+  ;  6: ADD VA, VF: VF is an input
+  LD VA, $F0
+  LD VF, $20
+  ADD VA, VF
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 12
+  LD [I], V1
+
+  ;  7: SUB, no borrow
+  LD VA, $30
+  LD VB, $10
+  LD VF, $00
+  SUB VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 14
+  LD [I], V1
+
+  ;  8: SUB, borrow
+  LD VA, $10
+  LD VB, $30
+  LD VF, $01
+  SUB VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 16
+  LD [I], V1
+
+  ;  9: SUB, equal
+  LD VA, $22
+  LD VB, $22
+  LD VF, $00
+  SUB VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 18
+  LD [I], V1
+
+  ; 10: SUB VF, VB: flag wins
+  LD VB, $30
+  LD VF, $10
+  SUB VF, VB
+  LD V0, VF
+  LD V1, VF
+  LD I, results + 20
+  LD [I], V1
+
+  ; 11: SHR (VB = $40 for shift-vy)
+  LD VA, $05
+  LD VB, $40
+  LD VF, $00
+  SHR VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 22
+  LD [I], V1
+
+  ; 12: SHR VF, VB: flag wins
+  LD VB, $02
+  LD VF, $03
+  SHR VF, VB
+  LD V0, VF
+  LD V1, VF
+  LD I, results + 24
+  LD [I], V1
+
+  ; 13: SUBN, no borrow
+  LD VA, $10
+  LD VB, $30
+  LD VF, $00
+  SUBN VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 26
+  LD [I], V1
+
+  ; 14: SUBN, borrow
+  LD VA, $30
+  LD VB, $10
+  LD VF, $01
+  SUBN VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 28
+  LD [I], V1
+
+  ; 15: SHL (VB = $01 for shift-vy)
+  LD VA, $81
+  LD VB, $01
+  LD VF, $00
+  SHL VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD I, results + 30
+  LD [I], V1
+
+  ; 16: SHL VF, VB: flag wins
+  LD VB, $80
+  LD VF, $40
+  SHL VF, VB
+  LD V0, VF
+  LD V1, VF
+  LD I, results + 32
+  LD [I], V1
+
+  LD V5, 34
+  CALL show
+end:
+  JP end
+
+; Draw the V5 bytes at results as hex digits, 7 bytes per row (uses V0-V5 and VF)
+show:
+  LD V2, 1                ; x
+  LD V3, 1                ; y
+  LD V4, 0                ; byte index
+show_loop:
+  LD I, results
+  ADD I, V4
+  LD V0, [I]
+  LD V1, V0               ; high nibble (SHR Vx, Vx shifts the same with or without shift-vy)
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 4
+  LD V1, $0F              ; low nibble
+  AND V1, V0
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 5
+  SE V2, 64               ; 7 bytes of 9 pixels after x = 1
+  JP show_next
+  LD V2, 1
+  ADD V3, 6
+show_next:
+  ADD V4, 1
+  SE V4, V5
+  JP show_loop
+  RET
+
+results:
@@ -0,0 +1,120 @@
+; keypad.ch8: FX0A, EX9E and EXA1 driven by tests/roms/keypad.keys (run with --ips 3000 so each sample fits well inside its key window)
+; Results, drawn as hex:
+;   FX0A key, then 4 samples of keys 0-7 / 8-F pressed (EX9E) and released (EXA1) bitmaps, then two more FX0A keys
+; Expected: 05  20 00 DF FF  20 04 DF FB  00 00 FF FF  00 80 FF 7F  0F 03
+
+start:
+  LD VE, 0                ; next result offset
+
+  LD V0, K                ; key 5 from frame 10
+  CALL store_v0
+
+  LD V6, 10               ; about frame 20: key 5
+  CALL wait_frames
+  CALL sample
+  LD V6, 20               ; about frame 40: keys 5 and A
+  CALL wait_frames
+  CALL sample
+  LD V6, 20               ; about frame 60: nothing
+  CALL wait_frames
+  CALL sample
+  LD V6, 20               ; about frame 80: key F
+  CALL wait_frames
+  CALL sample
+
+  LD V0, K                ; key F is still held, no wait
+  CALL store_v0
+  LD V6, 30               ; about frame 110: nothing held, FX0A waits for key 3 at frame 130
+  CALL wait_frames
+  LD V0, K
+  CALL store_v0
+
+  LD V5, VE
+  CALL show
+end:
+  JP end
+
+
+; Store V0 at the next result
+store_v0:
+  LD I, results
+  ADD I, VE
+  LD [I], V0
+  ADD VE, 1
+  RET
+
+
+; Wait V6 frames on the delay timer
+wait_frames:
+  LD DT, V6
+wait_loop:
+  LD V6, DT
+  SE V6, 0
+  JP wait_loop
+  RET
+
+
+; Store pressed bits of keys 0-7 and 8-F (EX9E), then released bits (EXA1), at the next 4 results
+sample:
+  LD V7, 0
+  CALL sample8
+  LD V0, VA
+  LD V2, VC
+  CALL sample8
+  LD V1, VA
+  LD V3, VC
+  LD I, results
+  ADD I, VE
+  LD [I], V3
+  ADD VE, 4
+  RET
+
+; Keys V7 to V7 + 7: VA = pressed bits (EX9E), VC = released bits (EXA1), key V7 is bit 0
+sample8:
+  LD VA, 0
+  LD VC, 0
+  LD V8, 1
+sample8_loop:
+  SKNP V7
+  OR VA, V8
+  SKP V7
+  OR VC, V8
+  ADD V7, 1
+  ADD V8, V8
+  SE V8, 0
+  JP sample8_loop
+  RET
+
+; Draw the V5 bytes at results as hex digits, 7 bytes per row (uses V0-V5 and VF)
+show:
+  LD V2, 1                ; x
+  LD V3, 1                ; y
+  LD V4, 0                ; byte index
+show_loop:
+  LD I, results
+  ADD I, V4
+  LD V0, [I]
+  LD V1, V0               ; high nibble (SHR Vx, Vx shifts the same with or without shift-vy)
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 4
+  LD V1, $0F              ; low nibble
+  AND V1, V0
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 5
+  SE V2, 64               ; 7 bytes of 9 pixels after x = 1
+  JP show_next
+  LD V2, 1
+  ADD V3, 6
+show_next:
+  ADD V4, 1
+  SE V4, V5
+  JP show_loop
+  RET
+
+results:
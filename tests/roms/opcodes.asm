@@ -0,0 +1,247 @@
+; opcodes.ch8: every CHIP-8 opcode once, run with tests/roms/opcodes.keys (key C is pressed at frame 100 for FX0A)
+; Test N stores one result byte at results + N, the 35 bytes are then drawn as hex (7 per row)
+; Expected (--seed 1, no quirks):
+;   2A 1A 77 1A 5A 0A F5    6XNN, 7XNN, 7XNN leaves VF, 8XY0, 8XY1, 8XY2, 8XY3
+;   05 F5 7A 06 0C A0 B1    8XY4, 8XY5, 8XY6, 8XY7, 8XYE, 3XNN skips, 3XNN does not
+;   C0 D0 E1 F0 5B 22 51    4XNN, 5XY0, 9XY0, 1NNN, 2NNN + 00EE, BNNN, CXNN (seed dependent)
+;   00 30 0C 1E F0 02 05    CXNN & $0F, FX15 + FX07, FX0A, ANNN + FX1E, FX29, FX33 (3 bytes)
+;   04 31 32 33 00 01 91    FX55 + FX65 (3 bytes), DXYN no collision, DXYN collision, EX9E + EXA1
+; 00E0 clears a sprite drawn at the start, DXYN at (62, 30) is clipped to the 2x2 corner, FX18 leaves ST at $FF
+
+start:
+  LD I, sprite            ; drawn here, cleared by 00E0
+  LD V0, 28
+  LD V1, 12
+  DRW V0, V1, 4
+  CLS
+
+  ; 0: 6XNN
+  LD V6, $2A
+  LD V0, V6
+  LD I, results + 0
+  LD [I], V0
+
+  ; 1, 2: 7XNN adds without touching VF
+  LD VF, $77
+  ADD V6, $F0
+  LD V0, V6
+  LD V1, VF
+  LD I, results + 1
+  LD [I], V1
+
+  ; 3 - 11: 8XY0 to 8XYE on a running value
+  LD V7, V6               ; 8XY0: $1A
+  LD V0, V7
+  LD V8, $40
+  OR V7, V8               ; 8XY1: $5A
+  LD V1, V7
+  LD V8, $0F
+  AND V7, V8              ; 8XY2: $0A
+  LD V2, V7
+  LD V8, $FF
+  XOR V7, V8              ; 8XY3: $F5
+  LD V3, V7
+  LD V8, $10
+  ADD V7, V8              ; 8XY4: $05
+  LD V4, V7
+  SUB V7, V8              ; 8XY5: $F5
+  LD V5, V7
+  SHR V7, V7              ; 8XY6: $7A
+  LD V9, V7
+  LD V8, $80
+  SUBN V7, V8             ; 8XY7: $80 - $7A = $06
+  LD VA, V7
+  SHL V7, V7              ; 8XYE: $0C
+  LD VB, V7
+  LD V6, V9
+  LD V7, VA
+  LD V8, VB
+  LD I, results + 3
+  LD [I], V8
+
+  ; 12 - 16: conditional skips (VA = $0C), each result shows whether the LD after the skip ran
+  LD VA, $0C
+  LD V0, $A0
+  SE VA, $0C              ; 3XNN, equal: skips
+  LD V0, $A1
+  LD V1, $B0
+  SE VA, $0D              ; 3XNN, not equal: no skip
+  LD V1, $B1
+  LD V2, $C0
+  SNE VA, $0D             ; 4XNN, not equal: skips
+  LD V2, $C1
+  LD VB, $0C
+  LD V3, $D0
+  SE VA, VB               ; 5XY0, equal: skips
+  LD V3, $D1
+  LD V4, $E0
+  SNE VA, VB              ; 9XY0, equal: no skip
+  LD V4, $E1
+  LD I, results + 12
+  LD [I], V4
+
+  ; 17: 1NNN jumps over an instruction
+  LD V0, $F0
+  JP jump_over
+  LD V0, $F1
+jump_over:
+  LD I, results + 17
+  LD [I], V0
+
+  ; 18: 2NNN and 00EE, two levels deep
+  CALL call_outer
+  LD I, results + 18
+  LD [I], V0
+
+  ; 19: BNNN jumps to jump_table + V0 (V2 is the same, so the BXNN quirk lands in the same place)
+  LD V0, 4
+  LD V2, 4
+  JP V0, jump_table
+
+  ; 20, 21: CXNN (seeded by --seed)
+jump_done:
+  LD I, results + 19
+  LD [I], V0
+  RND V0, $FF
+  RND V1, $0F
+  LD I, results + 20
+  LD [I], V1
+
+  ; 22: FX15 then FX07 in the same frame, then wait for DT to count down to 0
+  LD V0, $30
+  LD DT, V0
+  LD V0, DT
+  LD I, results + 22
+  LD [I], V0
+dt_wait:
+  LD V0, DT
+  SE V0, 0
+  JP dt_wait
+
+  ; 23: FX0A waits for the scripted key
+  LD V0, K
+  LD I, results + 23
+  LD [I], V0
+
+  ; 24: ANNN + FX1E, stores $1E at results + 24
+  LD V1, 24
+  LD I, results
+  ADD I, V1
+  LD V0, $1E
+  LD [I], V0
+
+  ; 25: FX29 points I at the font sprite of digit A, its first row is $F0
+  LD V1, $0A
+  LD F, V1
+  LD V0, [I]
+  LD I, results + 25
+  LD [I], V0
+
+  ; 26 - 28: FX33 of 254
+  LD V1, 254
+  LD I, results + 26
+  LD B, V1
+
+  ; 29 - 31: FX55 then FX65 through a scratch buffer
+  LD V0, $31
+  LD V1, $32
+  LD V2, $33
+  LD I, scratch
+  LD [I], V2
+  LD V0, 0
+  LD V1, 0
+  LD V2, 0
+  LD I, scratch
+  LD V2, [I]
+  LD I, results + 29
+  LD [I], V2
+
+  ; 32, 33: DXYN sets VF only when a lit pixel is turned off
+  LD I, sprite
+  LD V6, 40
+  LD V7, 20
+  DRW V6, V7, 4
+  LD V0, VF
+  DRW V6, V7, 4
+  LD V1, VF
+  LD I, results + 32
+  LD [I], V1
+
+  ; 34: no key is pressed any more: EX9E does not skip, EXA1 does
+  LD V1, $0C
+  LD V0, $90
+  SKP V1
+  LD V0, $91
+  SKNP V1
+  ADD V0, $10
+  LD I, results + 34
+  LD [I], V0
+
+  ; DXYN clips at the bottom right corner instead of wrapping
+  LD I, sprite
+  LD V6, 62
+  LD V7, 30
+  DRW V6, V7, 4
+
+  LD V5, 35
+  CALL show
+
+  ; FX18
+  LD V0, $FF
+  LD ST, V0
+end:
+  JP end
+
+call_outer:
+  LD V0, $5A
+  CALL call_inner
+  RET
+call_inner:
+  ADD V0, 1
+  RET
+
+jump_table:
+  LD V0, $11
+  JP jump_done
+  LD V0, $22
+  JP jump_done
+
+sprite:
+  DB $F0, $90, $90, $F0
+
+; Draw the V5 bytes at results as hex digits, 7 bytes per row (uses V0-V5 and VF)
+show:
+  LD V2, 1                ; x
+  LD V3, 1                ; y
+  LD V4, 0                ; byte index
+show_loop:
+  LD I, results
+  ADD I, V4
+  LD V0, [I]
+  LD V1, V0               ; high nibble (SHR Vx, Vx shifts the same with or without shift-vy)
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 4
+  LD V1, $0F              ; low nibble
+  AND V1, V0
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 5
+  SE V2, 64               ; 7 bytes of 9 pixels after x = 1
+  JP show_next
+  LD V2, 1
+  ADD V3, 6
+show_next:
+  ADD V4, 1
+  SE V4, V5
+  JP show_loop
+  RET
+
+scratch:
+  DB 0, 0, 0
+
+results:
@@ -0,0 +1,59 @@
+; quirk_jump_vx.ch8: BXNN jumps to XNN + VX (QUIRK_JUMP_VX, --quirks jump-vx or --platform chip48 / schip)
+; JP V0, jump_table is B2NN (jump_table is at $2NN), so the quirk adds V2 instead of V0
+; Stores the value set by the table entry it landed on, and draws it as hex
+; Expected without the quirk: B0, with it: C0
+
+start:
+  LD V0, 4
+  LD V2, 8
+  JP V0, jump_table
+jump_done:
+  LD V0, V5
+  LD I, results
+  LD [I], V0
+  LD V5, 1
+  CALL show
+end:
+  JP end
+
+jump_table:
+  LD V5, $A0
+  JP jump_done
+  LD V5, $B0
+  JP jump_done
+  LD V5, $C0
+  JP jump_done
+
+; Draw the V5 bytes at results as hex digits, 7 bytes per row (uses V0-V5 and VF)
+show:
+  LD V2, 1                ; x
+  LD V3, 1                ; y
+  LD V4, 0                ; byte index
+show_loop:
+  LD I, results
+  ADD I, V4
+  LD V0, [I]
+  LD V1, V0               ; high nibble (SHR Vx, Vx shifts the same with or without shift-vy)
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 4
+  LD V1, $0F              ; low nibble
+  AND V1, V0
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 5
+  SE V2, 64               ; 7 bytes of 9 pixels after x = 1
+  JP show_next
+  LD V2, 1
+  ADD V3, 6
+show_next:
+  ADD V4, 1
+  SE V4, V5
+  JP show_loop
+  RET
+
+results:
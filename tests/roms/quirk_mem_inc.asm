@@ -0,0 +1,68 @@
+; quirk_mem_inc.ch8: FX55/FX65 leave I past the last register (QUIRK_MEMORY_INCREMENT, --quirks mem-inc or --platform vip)
+; A second FX55 / FX65 through the same I shows where I was left, the results are drawn as hex:
+; store_buffer after storing 11 22 33 then EE (4 bytes), then V0 after loading load_buffer twice
+; Expected without the quirk: EE 22 33 00 44, with it: 11 22 33 EE 66
+
+start:
+  LD I, load_buffer
+  LD V1, [I]              ; V0 = 44, V1 = 55
+  LD V0, [I]              ; from load_buffer again (44), or from load_buffer + 2 (66) with the quirk
+  LD VA, V0
+
+  LD V0, $11
+  LD V1, $22
+  LD V2, $33
+  LD I, store_buffer
+  LD [I], V2
+  LD V0, $EE
+  LD [I], V0              ; over the $11, or after the $33 with the quirk
+
+  LD I, store_buffer
+  LD V3, [I]
+  LD V4, VA
+  LD I, results
+  LD [I], V4
+  LD V5, 5
+  CALL show
+end:
+  JP end
+
+load_buffer:
+  DB $44, $55, $66, $77
+
+store_buffer:
+  DB 0, 0, 0, 0
+
+; Draw the V5 bytes at results as hex digits, 7 bytes per row (uses V0-V5 and VF)
+show:
+  LD V2, 1                ; x
+  LD V3, 1                ; y
+  LD V4, 0                ; byte index
+show_loop:
+  LD I, results
+  ADD I, V4
+  LD V0, [I]
+  LD V1, V0               ; high nibble (SHR Vx, Vx shifts the same with or without shift-vy)
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 4
+  LD V1, $0F              ; low nibble
+  AND V1, V0
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 5
+  SE V2, 64               ; 7 bytes of 9 pixels after x = 1
+  JP show_next
+  LD V2, 1
+  ADD V3, 6
+show_next:
+  ADD V4, 1
+  SE V4, V5
+  JP show_loop
+  RET
+
+results:
@@ -0,0 +1,59 @@
+; quirk_shift_vy.ch8: 8XY6/8XYE shift VY into VX (QUIRK_SHIFT_USES_VY, --quirks shift-vy or --platform vip)
+; Stores VX, VF and VY after SHR VA, VB and SHL VA, VB, and draws the 6 bytes as hex
+; Expected without the quirk: 02 01 40 02 01 01, with it: 20 00 40 02 00 01
+
+start:
+  LD VA, $05
+  LD VB, $40
+  SHR VA, VB
+  LD V0, VA
+  LD V1, VF
+  LD V2, VB
+
+  LD VA, $81
+  LD VB, $01
+  SHL VA, VB
+  LD V3, VA
+  LD V4, VF
+  LD V5, VB
+
+  LD I, results
+  LD [I], V5
+  LD V5, 6
+  CALL show
+end:
+  JP end
+
+; Draw the V5 bytes at results as hex digits, 7 bytes per row (uses V0-V5 and VF)
+show:
+  LD V2, 1                ; x
+  LD V3, 1                ; y
+  LD V4, 0                ; byte index
+show_loop:
+  LD I, results
+  ADD I, V4
+  LD V0, [I]
+  LD V1, V0               ; high nibble (SHR Vx, Vx shifts the same with or without shift-vy)
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 4
+  LD V1, $0F              ; low nibble
+  AND V1, V0
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 5
+  SE V2, 64               ; 7 bytes of 9 pixels after x = 1
+  JP show_next
+  LD V2, 1
+  ADD V3, 6
+show_next:
+  ADD V4, 1
+  SE V4, V5
+  JP show_loop
+  RET
+
+results:
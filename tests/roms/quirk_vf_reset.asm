@@ -0,0 +1,70 @@
+; quirk_vf_reset.ch8: VF after 8XY1/8XY2/8XY3 (QUIRK_VF_RESET, --quirks vf-reset or --platform vip)
+; Stores VX and VF after OR, AND and XOR, then VF after OR VF, VB, and draws the 7 bytes as hex
+; Expected without the quirk: FF 77 0C 77 33 77 F7, with it: FF 00 0C 00 33 00 00
+
+start:
+  LD VA, $0F
+  LD VB, $F0
+  LD VF, $77
+  OR VA, VB
+  LD V0, VA
+  LD V1, VF
+
+  LD VA, $3C
+  LD VB, $0F
+  LD VF, $77
+  AND VA, VB
+  LD V2, VA
+  LD V3, VF
+
+  LD VA, $3C
+  LD VF, $77
+  XOR VA, VB
+  LD V4, VA
+  LD V5, VF
+
+  LD VB, $80
+  LD VF, $77
+  OR VF, VB               ; X = F: the reset wins over the OR result
+  LD V6, VF
+
+  LD I, results
+  LD [I], V6
+  LD V5, 7
+  CALL show
+end:
+  JP end
+
+; Draw the V5 bytes at results as hex digits, 7 bytes per row (uses V0-V5 and VF)
+show:
+  LD V2, 1                ; x
+  LD V3, 1                ; y
+  LD V4, 0                ; byte index
+show_loop:
+  LD I, results
+  ADD I, V4
+  LD V0, [I]
+  LD V1, V0               ; high nibble (SHR Vx, Vx shifts the same with or without shift-vy)
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  SHR V1, V1
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 4
+  LD V1, $0F              ; low nibble
+  AND V1, V0
+  LD F, V1
+  DRW V2, V3, 5
+  ADD V2, 5
+  SE V2, 64               ; 7 bytes of 9 pixels after x = 1
+  JP show_next
+  LD V2, 1
+  ADD V3, 6
+show_next:
+  ADD V4, 1
+  SE V4, V5
+  JP show_loop
+  RET
+
+results:
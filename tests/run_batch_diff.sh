@@ -0,0 +1,66 @@
+#!/bin/sh
+# Differential check of the batch interpreter: run every ROM in tests/conformance.txt on a few batch lanes and compare each
+# lane's state hash with a single instance run using that lane's seed
+# Usage (from the repository root): tests/run_batch_diff.sh [EMULATOR]   (default build/chip8Emu)
+
+EMULATOR=${1:-build/chip8Emu}
+MANIFEST=tests/conformance.txt
+OUT_DIR=tests/out
+LANES=4
+SEED=1
+
+if [ ! -x "$EMULATOR" ]; then
+  echo "No emulator at $EMULATOR (run make first)"
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+grep -v -e '^#' -e '^[[:space:]]*$' "$MANIFEST" > "$OUT_DIR/batch_diff_tests.txt"
+
+PASSED=0
+FAILED=0
+while read -r NAME ROM FRAMES HASH OPTIONS; do
+  # The batch interpreter has no VIP cycle timing
+  case "$OPTIONS" in
+    *--vip-timing*) echo "SKIP  batch $NAME (VIP timing)"; continue ;;
+  esac
+
+  # Lane N runs with seed SEED + N, its line is "Lane N seed S state hash after F frames: HASH"
+  # An --input-script (lines for lane 0 or *) is given to the batch as its --batch-input
+  BATCH_OPTIONS=$(echo "$OPTIONS" | sed 's/--input-script/--batch-input/')
+  if ! "$EMULATOR" "$ROM" --no-library --seed "$SEED" --batch "$LANES" --batch-frames "$FRAMES" $BATCH_OPTIONS \
+       > "$OUT_DIR/batch_$NAME.log" 2>&1 < /dev/null; then
+    echo "FAIL  batch $NAME  (batch run failed, log $OUT_DIR/batch_$NAME.log)"
+    FAILED=$((FAILED + 1))
+    continue
+  fi
+
+  MISMATCHES=""
+  LANES_SEEN=0
+  while read -r _ LANE _ LANE_SEED _ _ _ _ _ LANE_HASH; do
+    LANES_SEEN=$((LANES_SEEN + 1))
+    SINGLE_HASH=$("$EMULATOR" "$ROM" --headless --uncapped --no-library --seed "$LANE_SEED" --frames "$FRAMES" --hash $OPTIONS \
+                    2> /dev/null < /dev/null | sed -n 's/.*state hash after .* frames: //p')
+    if [ "$SINGLE_HASH" != "$LANE_HASH" ]; then
+      MISMATCHES="$MISMATCHES lane $LANE ($LANE_HASH, single $SINGLE_HASH)"
+    fi
+  done <<LANES_EOF
+$(grep '^Lane ' "$OUT_DIR/batch_$NAME.log")
+LANES_EOF
+
+  if [ "$LANES_SEEN" -ne "$LANES" ]; then
+    MISMATCHES="$MISMATCHES $LANES_SEEN of $LANES lane hashes printed"
+  fi
+
+  if [ -z "$MISMATCHES" ]; then
+    echo "PASS  batch $NAME"
+    PASSED=$((PASSED + 1))
+  else
+    echo "FAIL  batch $NAME :$MISMATCHES"
+    FAILED=$((FAILED + 1))
+  fi
+done < "$OUT_DIR/batch_diff_tests.txt"
+
+echo "$PASSED batch ROMs match single instance runs, $FAILED differ"
+
+[ "$FAILED" -eq 0 ]
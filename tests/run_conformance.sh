@@ -0,0 +1,48 @@
+#!/bin/sh
+# Run every test in tests/conformance.txt headless and in parallel, and check its state hash
+# Usage (from the repository root): tests/run_conformance.sh [EMULATOR]   (default build/chip8Emu)
+
+EMULATOR=${1:-build/chip8Emu}
+MANIFEST=tests/conformance.txt
+GOLDEN_DIR=tests/golden
+OUT_DIR=tests/out
+
+# One test (the script runs itself through xargs for each manifest line)
+if [ "$1" = "--run-one" ]; then
+  EMULATOR=$2
+  NAME=$3
+  ROM=$4
+  FRAMES=$5
+  HASH=$6
+  shift 6
+
+  if [ -f "$GOLDEN_DIR/$NAME.png" ]; then
+    set -- "$@" --hash-diff-png "$GOLDEN_DIR/$NAME.png" "$OUT_DIR/$NAME.diff.png"
+  fi
+
+  if "$EMULATOR" "$ROM" --headless --uncapped --no-library --seed 1 --frames "$FRAMES" --expect-hash "$HASH" \
+       --hash-fail-png "$OUT_DIR/$NAME.png" "$@" > "$OUT_DIR/$NAME.log" 2>&1; then
+    echo "PASS  $NAME"
+  else
+    echo "FAIL  $NAME  (log $OUT_DIR/$NAME.log, frame $OUT_DIR/$NAME.png, diff $OUT_DIR/$NAME.diff.png)"
+  fi
+  exit 0
+fi
+
+if [ ! -x "$EMULATOR" ]; then
+  echo "No emulator at $EMULATOR (run make first)"
+  exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+rm -f "$OUT_DIR"/*
+
+JOBS=$(nproc 2>/dev/null || echo 4)
+RESULTS=$(grep -v -e '^#' -e '^[[:space:]]*$' "$MANIFEST" | xargs -L 1 -P "$JOBS" sh "$0" --run-one "$EMULATOR")
+
+echo "$RESULTS" | sort
+PASSED=$(echo "$RESULTS" | grep -c '^PASS')
+FAILED=$(echo "$RESULTS" | grep -c '^FAIL')
+echo "$PASSED passed, $FAILED failed"
+
+[ "$FAILED" -eq 0 ]
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Build tests/render_check.c with the portable render kernels and with each SIMD level this machine runs, and check they all
+# draw the same frames
+# Usage (from the repository root): tests/run_render_check.sh
+# SDL_CFLAGS / SDL_LIBS default to sdl2-config's
+
+CC=${CC:-gcc}
+SDL_CFLAGS=${SDL_CFLAGS-$(sdl2-config --cflags) -I/usr/include/SDL2}
+SDL_LIBS=${SDL_LIBS-$(sdl2-config --libs)}
+OUT_DIR=tests/out
+
+mkdir -p "$OUT_DIR"
+
+# Build one variant and print its hashes into OUT_DIR/render_VARIANT.txt
+run_variant()
+{
+  VARIANT=$1
+  shift
+
+  if ! $CC tests/render_check.c -o "$OUT_DIR/render_check_$VARIANT" -std=c17 -O2 -Wall -Wextra "$@" $SDL_CFLAGS $SDL_LIBS; then
+    echo "FAIL  render $VARIANT (does not build)"
+    return 1
+  fi
+
+  "$OUT_DIR/render_check_$VARIANT" > "$OUT_DIR/render_$VARIANT.txt"
+}
+
+run_variant scalar -DCHIP8_SCALAR_RENDER || exit 1
+
+# Default flags give SSE2 on x86-64, AVX2 (with the gathers) only runs where the CPU has it
+VARIANTS="default"
+if grep -q avx2 /proc/cpuinfo 2>/dev/null; then
+  VARIANTS="$VARIANTS avx2"
+fi
+
+FAILED=0
+for VARIANT in $VARIANTS; do
+  if [ "$VARIANT" = "avx2" ]; then
+    run_variant avx2 -mavx2 || { FAILED=1; continue; }
+  else
+    run_variant "$VARIANT" || { FAILED=1; continue; }
+  fi
+
+  if diff "$OUT_DIR/render_scalar.txt" "$OUT_DIR/render_$VARIANT.txt" > "$OUT_DIR/render_$VARIANT.diff"; then
+    echo "PASS  render $VARIANT matches scalar"
+  else
+    echo "FAIL  render $VARIANT differs from scalar (modes in $OUT_DIR/render_$VARIANT.diff)"
+    FAILED=1
+  fi
+done
+
+[ "$FAILED" -eq 0 ]